@@ -2,26 +2,24 @@
 #include "d6502_private.h"
 #include <stdio.h>
 
+// the operand bytes were read (or taken from the decode cache) by fetch()
 static uint8_t immediate8(d6502_t *cpu) {
-    return cpu->read(cpu->pc + 1);
+    return cpu->operand & 0xff;
 }
 
 static uint16_t immediate16(d6502_t *cpu) {
-    return read16(cpu, cpu->pc + 1);
+    return cpu->operand;
 }
 
 void Implied(d6502_t *cpu) {
-    cpu->disassemble[0] = 0;
 }
 
 void Accumulator(d6502_t *cpu) {
-    sprintf(cpu->disassemble, "A");
 }
 
 void Immediate(d6502_t *cpu) {
     // LDA #$0A
     cpu->addr = cpu->pc + 1;
-    sprintf(cpu->disassemble, "#$%02X", immediate8(cpu));
 }
 
 void Indirect(d6502_t *cpu) {
@@ -29,49 +27,43 @@ void Indirect(d6502_t *cpu) {
     uint16_t imm = immediate16(cpu);
     uint16_t hi = imm & 0xff00;
     uint8_t lo = imm & 0xff;
-    cpu->addr = cpu->read(hi | lo++);
-    cpu->addr |= cpu->read(hi | lo) << 8;
-    sprintf(cpu->disassemble, "($%04X)", imm);
+    cpu->addr = read8(cpu, hi | lo++);
+    cpu->addr |= read8(cpu, hi | lo) << 8;
 }
 
 void IndirectX(d6502_t *cpu) {
     // LDA ($3E, X)
     uint8_t zp_addr = immediate8(cpu);
     uint8_t addr = zp_addr + cpu->x; // using uint8 for zeropage-wrap-around
-    cpu->addr = cpu->read(addr++);
-    cpu->addr |= cpu->read(addr) << 8;
-    sprintf(cpu->disassemble, "($%02X,X)", zp_addr);
+    cpu->addr = read8(cpu, addr++);
+    cpu->addr |= read8(cpu, addr) << 8;
 }
 
 void IndirectY(d6502_t *cpu) {
     // LDA ($4C), Y
     uint16_t zp_addr = immediate8(cpu);
     uint8_t addr = zp_addr; // using uint8 for zeropage-wrap-around
-    cpu->addr = cpu->read(addr++);
-    cpu->addr |= ((uint16_t)cpu->read(addr)) << 8;
+    cpu->addr = read8(cpu, addr++);
+    cpu->addr |= ((uint16_t)read8(cpu, addr)) << 8;
     cpu->extra_clocks += PAGE_WRAP(cpu->addr, cpu->addr + cpu->y);
     cpu->addr += cpu->y;
-    sprintf(cpu->disassemble, "($%02X),Y", zp_addr);
 }
 
 void ZeroPage(d6502_t *cpu) {
     // LDA $20
     cpu->addr = immediate8(cpu);
-    sprintf(cpu->disassemble, "$%02X", cpu->addr);
 }
 
 void ZeroPageX(d6502_t *cpu) {
     // LDA $20, X
     uint8_t zp_addr = immediate8(cpu);
     cpu->addr = (zp_addr + cpu->x) & 0xFF;
-    sprintf(cpu->disassemble, "$%02X,X", zp_addr);
 }
 
 void ZeroPageY(d6502_t *cpu) {
     // LDX $10, Y
     uint8_t zp_addr = immediate8(cpu);
     cpu->addr = (zp_addr + cpu->y) & 0xFF;
-    sprintf(cpu->disassemble, "$%02X,Y", zp_addr);
 }
 
 void AbsoluteX(d6502_t *cpu) {
@@ -79,7 +71,6 @@ void AbsoluteX(d6502_t *cpu) {
     uint16_t a1 = immediate16(cpu);
     cpu->addr = a1 + cpu->x;
     cpu->extra_clocks += PAGE_WRAP(a1, cpu->addr);
-    sprintf(cpu->disassemble, "$%04X,X", a1);
 }
 
 void AbsoluteY(d6502_t *cpu) {
@@ -87,12 +78,10 @@ void AbsoluteY(d6502_t *cpu) {
     uint16_t a1 = immediate16(cpu);
     cpu->addr = a1 + cpu->y;
     cpu->extra_clocks += PAGE_WRAP(a1, cpu->addr);
-    sprintf(cpu->disassemble, "$%04X,Y", a1);
 }
 
 void Absolute(d6502_t *cpu) {
     cpu->addr = immediate16(cpu);
-    sprintf(cpu->disassemble, "$%04X", cpu->addr);
 }
 
 void Relative(d6502_t *cpu) {
@@ -101,6 +90,45 @@ void Relative(d6502_t *cpu) {
         im |= 0xFF00;
     }
     cpu->addr = cpu->pc + im;
-    uint16_t disp = cpu->addr + cpu->instruction->len;
-    sprintf(cpu->disassemble, "$%02X", disp);
+}
+
+void (*const addressing_modes[])(d6502_t *cpu) = {
+    [MODE_IMPLIED]     = Implied,
+    [MODE_ACCUMULATOR] = Accumulator,
+    [MODE_IMMEDIATE]   = Immediate,
+    [MODE_INDIRECT]    = Indirect,
+    [MODE_INDIRECT_X]  = IndirectX,
+    [MODE_INDIRECT_Y]  = IndirectY,
+    [MODE_ZEROPAGE]    = ZeroPage,
+    [MODE_ZEROPAGE_X]  = ZeroPageX,
+    [MODE_ZEROPAGE_Y]  = ZeroPageY,
+    [MODE_ABSOLUTE_X]  = AbsoluteX,
+    [MODE_ABSOLUTE_Y]  = AbsoluteY,
+    [MODE_ABSOLUTE]    = Absolute,
+    [MODE_RELATIVE]    = Relative,
+};
+
+// Operand formatting for the disassembler. Kept apart from the addressing
+// modes above, so executing instructions never formats text.
+void format_operand(const instruction_t *instruction, uint16_t pc, uint16_t operand, char *s) {
+    uint8_t op8 = operand & 0xff;
+    switch (instruction->mode) {
+        case MODE_ACCUMULATOR: sprintf(s, "A"); break;
+        case MODE_IMMEDIATE:   sprintf(s, "#$%02X", op8); break;
+        case MODE_INDIRECT:    sprintf(s, "($%04X)", operand); break;
+        case MODE_INDIRECT_X:  sprintf(s, "($%02X,X)", op8); break;
+        case MODE_INDIRECT_Y:  sprintf(s, "($%02X),Y", op8); break;
+        case MODE_ZEROPAGE:    sprintf(s, "$%02X", op8); break;
+        case MODE_ZEROPAGE_X:  sprintf(s, "$%02X,X", op8); break;
+        case MODE_ZEROPAGE_Y:  sprintf(s, "$%02X,Y", op8); break;
+        case MODE_ABSOLUTE_X:  sprintf(s, "$%04X,X", operand); break;
+        case MODE_ABSOLUTE_Y:  sprintf(s, "$%04X,Y", operand); break;
+        case MODE_ABSOLUTE:    sprintf(s, "$%04X", operand); break;
+        case MODE_RELATIVE: {
+            uint16_t disp = pc + (int8_t)op8 + instruction->len;
+            sprintf(s, "$%02X", disp);
+            break;
+        }
+        default: s[0] = 0;
+    }
 }
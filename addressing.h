@@ -17,4 +17,9 @@ void AbsoluteY(d6502_t *cpu);
 void Absolute(d6502_t *cpu);
 void Relative(d6502_t *cpu);
 
+// addressing mode functions, indexed by addressing_mode_t
+extern void (*const addressing_modes[])(d6502_t *cpu);
+
+void format_operand(const instruction_t *instruction, uint16_t pc, uint16_t operand, char *s);
+
 #endif
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+#include "threaded.h"
+
+// Static analysis. The code of a ROM image is found by following the
+// control flow from the vectors: every reached instruction is marked code,
+// branch and JSR fall through to the next instruction, branch, JMP and JSR
+// targets inside the image are queued, and so is the address pushed right
+// before an RTS (the RTS trick). JMP indirect is not followed. Everything
+// else in the image is data. A basic block starts at every target, after
+// every branch and after every JSR, like the blocks of threaded.c. A
+// subroutine spans the code reachable from its entry without following
+// JSR or jumps into other subroutines, its last instruction is the one at
+// the highest address.
+
+#define OP_BRK 0x00
+#define OP_JSR 0x20
+#define OP_RTI 0x40
+#define OP_PHA 0x48
+#define OP_JMP 0x4C
+#define OP_RTS 0x60
+#define OP_JMP_INDIRECT 0x6C
+#define OP_LDA_IMMEDIATE 0xA9
+#define OP_END 0xFF
+
+typedef struct {
+    d6502_analysis_t *a;
+    const uint8_t *buf;
+    int size;
+    uint16_t addr;
+    uint16_t *stack; // addresses to visit, each is pushed once
+    int depth;
+    uint8_t pushed[0x2000]; // bitmap
+} walk_t;
+
+static bool inside(const walk_t *w, uint16_t addr) {
+    return (uint16_t)(addr - w->addr) < w->size;
+}
+
+static uint8_t byte(const walk_t *w, uint16_t addr) {
+    return w->buf[(uint16_t)(addr - w->addr)];
+}
+
+static void push(walk_t *w, uint16_t addr) {
+    if (!(w->pushed[addr >> 3] & (1 << (addr & 7)))) {
+        w->pushed[addr >> 3] |= 1 << (addr & 7);
+        w->stack[w->depth++] = addr;
+    }
+}
+
+static void xref(walk_t *w, uint16_t from, uint16_t to, uint8_t kind) {
+    d6502_analysis_t *a = w->a;
+    if (a->xref_count < a->max_xrefs) {
+        a->xrefs[a->xref_count++] = (d6502_xref_t){ from, to, kind };
+    }
+}
+
+// queues a target inside the image
+static void target(walk_t *w, uint16_t from, uint16_t to, uint8_t kind, uint8_t flags) {
+    xref(w, from, to, kind);
+    if (inside(w, to)) {
+        w->a->flags[to] |= flags;
+        push(w, to);
+    }
+}
+
+// returns the instruction at pc, NULL if it is undefined or cut off
+static const instruction_t *instruction_at(const walk_t *w, uint16_t pc) {
+    const instruction_t *instruction = get_instruction(byte(w, pc));
+    if (instruction->operation == NULL || (uint16_t)(pc - w->addr) + instruction->len > w->size) {
+        return NULL;
+    }
+    return instruction;
+}
+
+// LDA #>(dest-1), PHA, LDA #<(dest-1), PHA, RTS jumps to dest
+static void rts_jump(walk_t *w, uint16_t pc) {
+    static const uint8_t pattern[6] = { OP_LDA_IMMEDIATE, 0, OP_PHA, OP_LDA_IMMEDIATE, 0, OP_PHA };
+    uint16_t start = pc - 6;
+    if ((uint16_t)(pc - w->addr) < 6) {
+        return;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (i != 1 && i != 4 && byte(w, start + i) != pattern[i]) {
+            return;
+        }
+    }
+    uint8_t *flags = w->a->flags;
+    if ((flags[start] & flags[(uint16_t)(start + 2)] & flags[(uint16_t)(start + 3)] & flags[(uint16_t)(start + 5)] & D6502_MAP_CODE)) {
+        uint16_t dest = (byte(w, start + 1) << 8 | byte(w, start + 4)) + 1;
+        target(w, pc, dest, D6502_XREF_JUMP, D6502_MAP_BLOCK | D6502_MAP_TARGET);
+    }
+}
+
+// follows the path from pc until it ends or joins known code
+static void follow(walk_t *w, uint16_t pc) {
+    uint8_t *flags = w->a->flags;
+    while (inside(w, pc) && !(flags[pc] & D6502_MAP_CODE)) {
+        const instruction_t *instruction = instruction_at(w, pc);
+        if (instruction == NULL) {
+            return;
+        }
+        flags[pc] |= D6502_MAP_CODE;
+        for (int i = 1; i < instruction->len; i++) {
+            flags[(uint16_t)(pc + i)] |= D6502_MAP_OPERAND;
+        }
+        uint16_t next = pc + instruction->len;
+        uint16_t operand = instruction->len > 2 ? byte(w, pc + 1) | (byte(w, pc + 2) << 8) : 0;
+        if (instruction->mode == MODE_RELATIVE) {
+            target(w, pc, next + (int8_t)byte(w, pc + 1), D6502_XREF_BRANCH, D6502_MAP_BLOCK | D6502_MAP_TARGET);
+        } else if (instruction->opcode == OP_JSR) {
+            target(w, pc, operand, D6502_XREF_CALL, D6502_MAP_BLOCK | D6502_MAP_SUB);
+        } else if (instruction->opcode == OP_JMP) {
+            target(w, pc, operand, D6502_XREF_JUMP, D6502_MAP_BLOCK | D6502_MAP_TARGET);
+            return;
+        } else if (instruction->opcode == OP_RTS) {
+            rts_jump(w, pc);
+            return;
+        } else if (instruction->opcode == OP_JMP_INDIRECT || instruction->opcode == OP_RTI
+            || instruction->opcode == OP_BRK || instruction->opcode == OP_END) {
+            return;
+        } else {
+            pc = next;
+            continue;
+        }
+        // branch or JSR, the next instruction starts a block
+        if (inside(w, next)) {
+            flags[next] |= D6502_MAP_BLOCK;
+        }
+        pc = next;
+    }
+}
+
+// marks the last instruction of the subroutine at 'entry'
+static void mark_sub_end(walk_t *w, uint16_t entry) {
+    uint8_t *flags = w->a->flags;
+    uint16_t last = entry;
+    memset(w->pushed, 0, sizeof(w->pushed));
+    w->depth = 0;
+    push(w, entry);
+    while (w->depth > 0) {
+        uint16_t pc = w->stack[--w->depth];
+        for (;;) {
+            if (pc > last) {
+                last = pc;
+            }
+            const instruction_t *instruction = get_instruction(byte(w, pc));
+            uint16_t next = pc + instruction->len;
+            uint16_t to = instruction->len > 2 ? byte(w, pc + 1) | (byte(w, pc + 2) << 8) : 0;
+            if (instruction->mode == MODE_RELATIVE) {
+                to = next + (int8_t)byte(w, pc + 1);
+            } else if (instruction->opcode != OP_JMP) {
+                to = pc; // no target
+            }
+            // jumps into other subroutines are tail calls
+            if (to != pc && inside(w, to) && (flags[to] & D6502_MAP_CODE) && !(flags[to] & D6502_MAP_SUB)) {
+                push(w, to);
+            }
+            if (instruction->opcode == OP_JMP || instruction->opcode == OP_JMP_INDIRECT || instruction->opcode == OP_RTS
+                || instruction->opcode == OP_RTI || instruction->opcode == OP_BRK || instruction->opcode == OP_END) {
+                break;
+            }
+            if (!inside(w, next) || !(flags[next] & D6502_MAP_CODE) || (w->pushed[next >> 3] & (1 << (next & 7)))) {
+                break;
+            }
+            w->pushed[next >> 3] |= 1 << (next & 7);
+            pc = next;
+        }
+    }
+    flags[last] |= D6502_MAP_SUB_END;
+}
+
+static int compare_xrefs(const void *p, const void *q) {
+    const d6502_xref_t *x = p;
+    const d6502_xref_t *y = q;
+    if (x->to != y->to) {
+        return x->to - y->to;
+    }
+    return x->from - y->from;
+}
+
+// FNV-1a of the image and where it is mapped
+static uint32_t hash_image(const uint8_t *buf, int size, uint16_t addr) {
+    uint32_t h = 2166136261u;
+    uint8_t head[6] = { addr, addr >> 8, size, size >> 8, size >> 16, size >> 24 };
+    for (int i = 0; i < 6; i++) {
+        h = (h ^ head[i]) * 16777619u;
+    }
+    for (int i = 0; i < size; i++) {
+        h = (h ^ buf[i]) * 16777619u;
+    }
+    return h;
+}
+
+bool d6502_analyze(d6502_analysis_t *a, const uint8_t *buf, int size, uint16_t addr,
+        const uint16_t *entries, int entry_count, d6502_xref_t *xrefs, int max_xrefs) {
+    if (size > 0x10000) {
+        size = 0x10000;
+    }
+    memset(a->flags, 0, sizeof(a->flags));
+    a->xrefs = xrefs;
+    a->max_xrefs = max_xrefs;
+    a->xref_count = 0;
+    a->hash = hash_image(buf, size, addr);
+    walk_t *w = calloc(1, sizeof(walk_t));
+    uint16_t *stack = malloc(0x10000 * sizeof(uint16_t));
+    if (w == NULL || stack == NULL) {
+        free(w);
+        free(stack);
+        return false;
+    }
+    *w = (walk_t){ .a = a, .buf = buf, .size = size, .addr = addr, .stack = stack };
+
+    static const uint16_t vectors[] = { RESET_ADDR, NMI_ADDR, INT_ADDR };
+    for (int i = 0; i < 3; i++) {
+        uint16_t v = vectors[i];
+        if (inside(w, v) && inside(w, v + 1)) {
+            uint16_t to = byte(w, v) | (byte(w, v + 1) << 8);
+            target(w, v, to, D6502_XREF_VECTOR, D6502_MAP_BLOCK | D6502_MAP_SUB | D6502_MAP_VECTOR);
+        }
+    }
+    for (int i = 0; i < entry_count; i++) {
+        if (inside(w, entries[i])) {
+            a->flags[entries[i]] |= D6502_MAP_BLOCK | D6502_MAP_SUB;
+            push(w, entries[i]);
+        }
+    }
+    while (w->depth > 0) {
+        follow(w, w->stack[--w->depth]);
+    }
+
+    for (int i = 0; i < size; i++) {
+        uint16_t pc = addr + i;
+        if (!(a->flags[pc] & (D6502_MAP_CODE | D6502_MAP_OPERAND))) {
+            // undefined opcodes at targets are data, too
+            a->flags[pc] = D6502_MAP_DATA;
+        } else if ((a->flags[pc] & (D6502_MAP_SUB | D6502_MAP_CODE)) == (D6502_MAP_SUB | D6502_MAP_CODE)) {
+            mark_sub_end(w, pc);
+        }
+    }
+    qsort(a->xrefs, a->xref_count, sizeof(d6502_xref_t), compare_xrefs);
+    free(stack);
+    free(w);
+    return true;
+}
+
+int d6502_analysis_refs(const d6502_analysis_t *a, uint16_t to, const d6502_xref_t **refs) {
+    // first entry with x.to >= to
+    int lo = 0;
+    int hi = a->xref_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (a->xrefs[mid].to < to) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    int n = 0;
+    while (lo + n < a->xref_count && a->xrefs[lo + n].to == to) {
+        n++;
+    }
+    *refs = &a->xrefs[lo];
+    return n;
+}
+
+bool d6502_analysis_label(const d6502_analysis_t *a, uint16_t addr, char *s) {
+    uint8_t flags = a->flags[addr];
+    if (flags & D6502_MAP_VECTOR) {
+        const d6502_xref_t *refs;
+        int n = d6502_analysis_refs(a, addr, &refs);
+        for (int i = 0; i < n; i++) {
+            if (refs[i].kind == D6502_XREF_VECTOR) {
+                strcpy(s, refs[i].from == RESET_ADDR ? "reset" : refs[i].from == NMI_ADDR ? "nmi" : "irq");
+                return true;
+            }
+        }
+    }
+    if (flags & D6502_MAP_SUB) {
+        sprintf(s, "sub_%04X", addr);
+        return true;
+    }
+    if (flags & D6502_MAP_TARGET) {
+        sprintf(s, "L_%04X", addr);
+        return true;
+    }
+    return false;
+}
+
+// Map file, little endian:
+//
+//   0  "d6502map"
+//   8  version
+//   9  reserved (0)
+//   10 hash of the image (4 bytes)
+//   14 number of cross references (4 bytes)
+//   18 flags of all 64K addresses
+//   65554 cross references, 5 bytes each: from (2), to (2), kind
+
+#define MAP_VERSION 1
+#define MAP_HEADER_SIZE 18
+
+bool d6502_analysis_save(const d6502_analysis_t *a, const char *fn) {
+    FILE *f = fopen(fn, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    uint8_t head[MAP_HEADER_SIZE] = "d6502map";
+    head[8] = MAP_VERSION;
+    head[9] = 0;
+    put32(head + 10, a->hash);
+    put32(head + 14, a->xref_count);
+    bool ok = fwrite(head, sizeof(head), 1, f) == 1 && fwrite(a->flags, sizeof(a->flags), 1, f) == 1;
+    for (int i = 0; ok && i < a->xref_count; i++) {
+        uint8_t x[5];
+        put16(x, a->xrefs[i].from);
+        put16(x + 2, a->xrefs[i].to);
+        x[4] = a->xrefs[i].kind;
+        ok = fwrite(x, sizeof(x), 1, f) == 1;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+bool d6502_analysis_load(d6502_analysis_t *a, const char *fn, const uint8_t *buf, int size, uint16_t addr,
+        d6502_xref_t *xrefs, int max_xrefs) {
+    if (size > 0x10000) {
+        size = 0x10000;
+    }
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    uint8_t head[MAP_HEADER_SIZE];
+    bool ok = fread(head, sizeof(head), 1, f) == 1 && memcmp(head, "d6502map", 8) == 0
+        && head[8] == MAP_VERSION && get32(head + 10) == hash_image(buf, size, addr)
+        && fread(a->flags, sizeof(a->flags), 1, f) == 1;
+    a->xrefs = xrefs;
+    a->max_xrefs = max_xrefs;
+    a->xref_count = 0;
+    a->hash = ok ? get32(head + 10) : 0;
+    uint32_t count = ok ? get32(head + 14) : 0;
+    // a part of the list would miss references
+    ok = ok && (int64_t)count <= max_xrefs;
+    for (uint32_t i = 0; ok && i < count; i++) {
+        uint8_t x[5];
+        ok = fread(x, sizeof(x), 1, f) == 1;
+        if (!ok) {
+            break;
+        }
+        xrefs[a->xref_count++] = (d6502_xref_t){ get16(x), get16(x + 2), x[4] };
+    }
+    fclose(f);
+    return ok;
+}
+
+void d6502_analysis_seed(d6502_t *cpu, const d6502_analysis_t *a) {
+    for (int pc = 0; pc < 0x10000; pc++) {
+        if (cpu->icache && (a->flags[pc] & D6502_MAP_CODE)) {
+            icache_prepare(cpu, pc);
+        }
+        if (cpu->blocks && (a->flags[pc] & D6502_MAP_BLOCK)) {
+            threaded_prepare(cpu, pc);
+        }
+    }
+}
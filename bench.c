@@ -0,0 +1,384 @@
+#include "d6502.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+// Microbenchmarks for the cpu core.
+//
+// Every workload is a fixed piece of 6502 code which ends with the END
+// opcode, so the number of executed instructions and cycles is the same
+// on every run. Each workload is run with each engine 'repeats' times and
+// the fastest run is reported. Short workloads are run several times in a
+// row per measurement. The engine 'group' runs D6502_GROUP_MAX instances
+// of the workload as a lockstep group, its instructions and cycles are
+// the sums over all instances. Output is CSV on stdout:
+//
+//   workload,engine,instructions,cycles,seconds,mhz,mips,host_cycles_per_instr
+//
+// host_cycles_per_instr is measured with the time stamp counter and is -1
+// on hosts without one.
+
+#define CODE_ADDR 0x8000
+
+typedef struct {
+    const char *name;
+    const uint8_t *code;
+    int len;
+    int passes;
+} workload_t;
+
+// nested INX/INY loop
+static const uint8_t loop_code[] = {
+    0xA2, 0x00,       // LDX #$00
+    0xA0, 0x00,       // LDY #$00
+    0xA9, 0x20,       // LDA #$20
+    0x85, 0x00,       // STA $00
+    0xE8,             // INX
+    0xD0, 0xFD,       // BNE $8008
+    0xC8,             // INY
+    0xD0, 0xFA,       // BNE $8008
+    0xC6, 0x00,       // DEC $00
+    0xD0, 0xF6,       // BNE $8008
+    0xFF,             // END
+};
+
+// copy 16 pages from $1000 to $2000, 128 times
+static const uint8_t memcpy_code[] = {
+    0xA9, 0x80,       // LDA #$80
+    0x85, 0x02,       // STA $02
+    0xA9, 0x10,       // LDA #$10
+    0x85, 0x01,       // STA $01
+    0xA9, 0x00,       // LDA #$00
+    0x85, 0x00,       // STA $00
+    0x85, 0x03,       // STA $03
+    0xA9, 0x20,       // LDA #$20
+    0x85, 0x04,       // STA $04
+    0xA2, 0x10,       // LDX #$10
+    0xA0, 0x00,       // LDY #$00
+    0xB1, 0x00,       // LDA ($00),Y
+    0x91, 0x03,       // STA ($03),Y
+    0xC8,             // INY
+    0xD0, 0xF9,       // BNE $8016
+    0xE6, 0x01,       // INC $01
+    0xE6, 0x04,       // INC $04
+    0xCA,             // DEX
+    0xD0, 0xF2,       // BNE $8016
+    0xC6, 0x02,       // DEC $02
+    0xD0, 0xDC,       // BNE $8004
+    0xFF,             // END
+};
+
+// 8x8 bit shift and add multiply of Y*Y, for all Y, 128 times
+static const uint8_t multiply_code[] = {
+    0xA9, 0x80,       // LDA #$80
+    0x85, 0x02,       // STA $02
+    0xA0, 0x00,       // LDY #$00
+    0x84, 0x11,       // STY $11
+    0x84, 0x10,       // STY $10
+    0x20, 0x20, 0x80, // JSR $8020
+    0x85, 0x12,       // STA $12
+    0xC8,             // INY
+    0xD0, 0xF4,       // BNE $8006
+    0xC6, 0x02,       // DEC $02
+    0xD0, 0xEE,       // BNE $8004
+    0xFF,             // END
+    0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,
+    // $8020: product of $10 and $11 in A (high) and $10 (low)
+    0xA9, 0x00,       // LDA #$00
+    0xA2, 0x08,       // LDX #$08
+    0x46, 0x10,       // LSR $10
+    0x90, 0x03,       // BCC $802B
+    0x18,             // CLC
+    0x65, 0x11,       // ADC $11
+    0x6A,             // ROR A
+    0x66, 0x10,       // ROR $10
+    0xCA,             // DEX
+    0xD0, 0xF5,       // BNE $8026
+    0x60,             // RTS
+};
+
+// branches taken and not taken depending on an LFSR
+static const uint8_t branch_code[] = {
+    0xA9, 0x01,       // LDA #$01
+    0x85, 0x00,       // STA $00
+    0xA9, 0x00,       // LDA #$00
+    0x85, 0x02,       // STA $02
+    0xA0, 0x00,       // LDY #$00
+    0xA5, 0x00,       // LDA $00
+    0x0A,             // ASL A
+    0x90, 0x02,       // BCC $8011
+    0x49, 0x1D,       // EOR #$1D
+    0x85, 0x00,       // STA $00
+    0x30, 0x03,       // BMI $8018
+    0xE8,             // INX
+    0x50, 0x01,       // BVC $8019
+    0xCA,             // DEX
+    0x4A,             // LSR A
+    0xB0, 0x02,       // BCS $801E
+    0xE6, 0x03,       // INC $03
+    0x4A,             // LSR A
+    0x90, 0x02,       // BCC $8023
+    0xC6, 0x03,       // DEC $03
+    0x88,             // DEY
+    0xD0, 0xE4,       // BNE $800A
+    0xC6, 0x02,       // DEC $02
+    0xD0, 0xDE,       // BNE $8008
+    0xFF,             // END
+};
+
+// ADC/SBC with zeropage and absolute,X operands
+static const uint8_t adcsbc_code[] = {
+    0xA9, 0x00,       // LDA #$00
+    0x85, 0x02,       // STA $02
+    0xA2, 0x00,       // LDX #$00
+    0x8A,             // TXA
+    0x18,             // CLC
+    0x65, 0x10,       // ADC $10
+    0x85, 0x10,       // STA $10
+    0x38,             // SEC
+    0xE5, 0x11,       // SBC $11
+    0x85, 0x11,       // STA $11
+    0x7D, 0x00, 0x03, // ADC $0300,X
+    0xFD, 0x00, 0x04, // SBC $0400,X
+    0x85, 0x12,       // STA $12
+    0xE8,             // INX
+    0xD0, 0xEA,       // BNE $8006
+    0xC6, 0x02,       // DEC $02
+    0xD0, 0xE4,       // BNE $8004
+    0xFF,             // END
+};
+
+// indexed stores across page boundaries
+static const uint8_t store_code[] = {
+    0xA9, 0x80,       // LDA #$80
+    0x85, 0x02,       // STA $02
+    0xA2, 0x00,       // LDX #$00
+    0xA0, 0x00,       // LDY #$00
+    0x9D, 0xF0, 0x02, // STA $02F0,X
+    0x99, 0x80, 0x04, // STA $0480,Y
+    0xE8,             // INX
+    0xC8,             // INY
+    0xC8,             // INY
+    0xD0, 0xF5,       // BNE $8008
+    0xC6, 0x02,       // DEC $02
+    0xD0, 0xED,       // BNE $8004
+    0xFF,             // END
+};
+
+static const workload_t workloads[] = {
+    { "loop", loop_code, sizeof(loop_code), 1 },
+    { "memcpy", memcpy_code, sizeof(memcpy_code), 1 },
+    { "multiply", multiply_code, sizeof(multiply_code), 1 },
+    { "branch", branch_code, sizeof(branch_code), 1 },
+    { "adcsbc", adcsbc_code, sizeof(adcsbc_code), 1 },
+    { "store", store_code, sizeof(store_code), 1 },
+};
+
+static const char *engine_names[] = { "table", "switch", "threaded" };
+
+static uint8_t image[0x10000]; // memory contents at reset
+static uint8_t memory[0x10000];
+static d6502_block_cache_t blocks;
+static d6502_t group_cpu[D6502_GROUP_MAX];
+static uint8_t group_memory[D6502_GROUP_MAX][0x10000];
+static d6502_group_t group;
+
+static void writebus(void *userdata, uint16_t addr, uint8_t dat) {
+    ((uint8_t *)userdata)[addr] = dat;
+}
+
+static uint8_t readbus(void *userdata, uint16_t addr) {
+    return ((uint8_t *)userdata)[addr];
+}
+
+// RAM below CODE_ADDR, immutable ROM above
+static void setup(d6502_t *cpu, d6502_engine_t engine, uint8_t *memory) {
+    memcpy(memory, image, 0x10000);
+    d6502_init(cpu);
+    cpu->read = readbus;
+    cpu->write = writebus;
+    cpu->userdata = memory;
+    cpu->engine = engine;
+    d6502_map_ram(cpu, 0, CODE_ADDR >> 8, memory);
+    d6502_map_rom(cpu, CODE_ADDR >> 8, 256 - (CODE_ADDR >> 8), memory + CODE_ADDR);
+    d6502_set_immutable(cpu, CODE_ADDR >> 8, 256 - (CODE_ADDR >> 8), true);
+    d6502_blocks_attach(cpu, engine == D6502_ENGINE_THREADED ? &blocks : NULL);
+    d6502_reset(cpu);
+}
+
+static long count_instructions(int passes) {
+    d6502_t cpu;
+    setup(&cpu, D6502_ENGINE_TABLE, memory);
+    while (!cpu.halt) {
+        d6502_run(&cpu, 1000000);
+    }
+    return d6502_instructions(&cpu) * passes;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t host_cycles(void) {
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void bench(const char *name, int passes, int repeats) {
+    long instructions = count_instructions(passes);
+    for (int e = 0; e < 3; e++) {
+        double best = 0;
+        uint64_t best_tsc = 0;
+        long cycles = 0;
+        for (int r = 0; r < repeats; r++) {
+            d6502_t cpu;
+            cycles = 0;
+            double t = 0;
+            uint64_t tsc = 0;
+            for (int p = 0; p < passes; p++) {
+                setup(&cpu, e, memory);
+                double t0 = now();
+                uint64_t c0 = host_cycles();
+                while (!cpu.halt) {
+                    cycles += d6502_run(&cpu, 1000000);
+                }
+                tsc += host_cycles() - c0;
+                t += now() - t0;
+            }
+            if (r == 0 || t < best) {
+                best = t;
+                best_tsc = tsc;
+            }
+        }
+#ifdef HAVE_RDTSC
+        double cpi = (double)best_tsc / instructions;
+#else
+        double cpi = -1;
+#endif
+        printf("%s,%s,%ld,%ld,%.6f,%.3f,%.3f,%.1f\n", name, engine_names[e],
+            instructions, cycles, best, cycles / best * 1e-6,
+            instructions / best * 1e-6, cpi);
+        fflush(stdout);
+    }
+}
+
+// Every instance of the group must end with the instruction and cycle
+// counts of a single cpu, else the benchmark fails.
+static bool bench_group(const char *name, int passes, int repeats) {
+    d6502_t ref;
+    setup(&ref, D6502_ENGINE_TABLE, memory);
+    while (!ref.halt) {
+        d6502_run(&ref, 1000000);
+    }
+    long instructions = d6502_instructions(&ref) * passes * D6502_GROUP_MAX;
+    long cycles = d6502_cycles(&ref) * passes * D6502_GROUP_MAX;
+    double best = 0;
+    uint64_t best_tsc = 0;
+    for (int r = 0; r < repeats; r++) {
+        double t = 0;
+        uint64_t tsc = 0;
+        for (int p = 0; p < passes; p++) {
+            d6502_group_init(&group);
+            for (int i = 0; i < D6502_GROUP_MAX; i++) {
+                setup(&group_cpu[i], D6502_ENGINE_TABLE, group_memory[i]);
+                d6502_group_add(&group, &group_cpu[i]);
+            }
+            double t0 = now();
+            uint64_t c0 = host_cycles();
+            bool running = true;
+            while (running) {
+                d6502_group_run(&group, 1000000);
+                running = false;
+                for (int i = 0; i < D6502_GROUP_MAX; i++) {
+                    running |= !group_cpu[i].halt;
+                }
+            }
+            tsc += host_cycles() - c0;
+            t += now() - t0;
+            for (int i = 0; i < D6502_GROUP_MAX; i++) {
+                d6502_t *cpu = &group_cpu[i];
+                if (d6502_cycles(cpu) != d6502_cycles(&ref) || d6502_instructions(cpu) != d6502_instructions(&ref)) {
+                    fprintf(stderr, "%s: group instance %d ran %lu instructions in %lu cycles, a single cpu %lu in %lu\n",
+                        name, i, (unsigned long)d6502_instructions(cpu), (unsigned long)d6502_cycles(cpu),
+                        (unsigned long)d6502_instructions(&ref), (unsigned long)d6502_cycles(&ref));
+                    return false;
+                }
+            }
+        }
+        if (r == 0 || t < best) {
+            best = t;
+            best_tsc = tsc;
+        }
+    }
+#ifdef HAVE_RDTSC
+    double cpi = (double)best_tsc / instructions;
+#else
+    double cpi = -1;
+#endif
+    printf("%s,group,%ld,%ld,%.6f,%.3f,%.3f,%.1f\n", name,
+        instructions, cycles, best, cycles / best * 1e-6,
+        instructions / best * 1e-6, cpi);
+    fflush(stdout);
+    return true;
+}
+
+static void load_workload(const workload_t *w) {
+    memset(image, 0, sizeof(image));
+    for (int i = 0; i < 0x200; i++) {
+        image[0x300 + i] = i * 37 + 11; // operands for adcsbc
+    }
+    memcpy(&image[CODE_ADDR], w->code, w->len);
+    image[RESET_ADDR] = CODE_ADDR & 0xff;
+    image[RESET_ADDR + 1] = CODE_ADDR >> 8;
+}
+
+// nestest in automation mode, starting at $C000. Ends at the first
+// undefined (END) opcode after the official opcode tests.
+static bool load_nestest(const char *fn) {
+    d6502_rom_t rom;
+    const uint8_t *prg = d6502_rom_open(&rom, fn) ? d6502_rom_prg_bank(&rom, 0, 0x4000) : NULL;
+    memset(image, 0, sizeof(image));
+    if (prg) {
+        memcpy(&image[0xc000], prg, 0x4000);
+    }
+    d6502_rom_close(&rom);
+    image[RESET_ADDR] = 0x00;
+    image[RESET_ADDR + 1] = 0xc0;
+    return prg != NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *nestest = argc > 1 ? argv[1] : "test/nestest.nes";
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    if (repeats < 1) {
+        repeats = 1;
+    }
+    printf("workload,engine,instructions,cycles,seconds,mhz,mips,host_cycles_per_instr\n");
+    for (int i = 0; i < (int)(sizeof(workloads) / sizeof(workloads[0])); i++) {
+        load_workload(&workloads[i]);
+        bench(workloads[i].name, workloads[i].passes, repeats);
+        if (!bench_group(workloads[i].name, workloads[i].passes, repeats)) {
+            return 1;
+        }
+    }
+    if (load_nestest(nestest)) {
+        bench("nestest", 100, repeats);
+        if (!bench_group("nestest", 100, repeats)) {
+            return 1;
+        }
+    } else {
+        fprintf(stderr, "cannot load %s\n", nestest);
+        return 1;
+    }
+    return 0;
+}
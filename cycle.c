@@ -0,0 +1,325 @@
+#include <stddef.h>
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+#include "addressing.h"
+#include "cycle.h"
+
+// Per-cycle bus mode, used by d6502_tick() and d6502_run() when
+// cpu->bus_mode is D6502_BUS_CYCLE. Every call of cycle_step() performs
+// the bus access of one clock cycle, in the order of the 6502:
+//
+// - read instructions read their operand on the last cycle, indexed modes
+//   first read the unfixed address when the index crosses a page
+// - write instructions always do the unfixed read of indexed modes and
+//   write on the last cycle
+// - read-modify-write instructions read, write the unmodified value back
+//   and write the result on the last three cycles
+// - zeropage indexed and (zp,X) modes read the unindexed address first
+// - single byte implied/accumulator instructions read the next byte
+//
+// The addressing is done here, the operations of operations.c run on the
+// cycle of their data access. All other instructions (branches, jumps,
+// stack instructions, BRK, RTI and the unofficial NOPs) fetch their
+// operand bytes on their own cycles and then execute at once on the last
+// cycle of their base timing, followed by idle cycles for page crossing
+// and taken branches. Their remaining accesses only go to the stack and
+// to program memory.
+//
+// Write and read-modify-write instructions with indexed addressing take
+// their fixed number of cycles, the unfixed read is part of their base
+// timing like in the instruction engines.
+
+enum {
+    CLASS_OTHER = 0,
+    CLASS_IMPLIED, // single byte, two cycles
+    CLASS_READ,
+    CLASS_WRITE,
+    CLASS_RMW
+};
+
+#define CLASS_ADC CLASS_READ
+#define CLASS_AND CLASS_READ
+#define CLASS_BIT CLASS_READ
+#define CLASS_CMP CLASS_READ
+#define CLASS_CPX CLASS_READ
+#define CLASS_CPY CLASS_READ
+#define CLASS_EOR CLASS_READ
+#define CLASS_LDA CLASS_READ
+#define CLASS_LDX CLASS_READ
+#define CLASS_LDY CLASS_READ
+#define CLASS_ORA CLASS_READ
+#define CLASS_SBC CLASS_READ
+#define CLASS_STA CLASS_WRITE
+#define CLASS_STX CLASS_WRITE
+#define CLASS_STY CLASS_WRITE
+#define CLASS_ASL CLASS_RMW
+#define CLASS_LSR CLASS_RMW
+#define CLASS_ROL CLASS_RMW
+#define CLASS_ROR CLASS_RMW
+#define CLASS_INC CLASS_RMW
+#define CLASS_DEC CLASS_RMW
+#define CLASS_CLC CLASS_IMPLIED
+#define CLASS_CLD CLASS_IMPLIED
+#define CLASS_CLI CLASS_IMPLIED
+#define CLASS_CLV CLASS_IMPLIED
+#define CLASS_DEX CLASS_IMPLIED
+#define CLASS_DEY CLASS_IMPLIED
+#define CLASS_INX CLASS_IMPLIED
+#define CLASS_INY CLASS_IMPLIED
+#define CLASS_NOP CLASS_IMPLIED
+#define CLASS_SEC CLASS_IMPLIED
+#define CLASS_SED CLASS_IMPLIED
+#define CLASS_SEI CLASS_IMPLIED
+#define CLASS_TAX CLASS_IMPLIED
+#define CLASS_TAY CLASS_IMPLIED
+#define CLASS_TSX CLASS_IMPLIED
+#define CLASS_TXA CLASS_IMPLIED
+#define CLASS_TXS CLASS_IMPLIED
+#define CLASS_TYA CLASS_IMPLIED
+#define CLASS_BCC CLASS_OTHER
+#define CLASS_BCS CLASS_OTHER
+#define CLASS_BEQ CLASS_OTHER
+#define CLASS_BMI CLASS_OTHER
+#define CLASS_BNE CLASS_OTHER
+#define CLASS_BPL CLASS_OTHER
+#define CLASS_BVC CLASS_OTHER
+#define CLASS_BVS CLASS_OTHER
+#define CLASS_BRK CLASS_OTHER
+#define CLASS_JMP CLASS_OTHER
+#define CLASS_JSR CLASS_OTHER
+#define CLASS_RTI CLASS_OTHER
+#define CLASS_RTS CLASS_OTHER
+#define CLASS_PHA CLASS_OTHER
+#define CLASS_PHP CLASS_OTHER
+#define CLASS_PLA CLASS_OTHER
+#define CLASS_PLP CLASS_OTHER
+#define CLASS_END CLASS_OTHER
+#define CLASS_ILL CLASS_OTHER
+#define CLASS_DCP CLASS_RMW
+#define CLASS_LAX CLASS_READ
+#define CLASS_SAX CLASS_WRITE
+#define CLASS_iSBC CLASS_READ
+
+// bus access pattern of every opcode, undefined opcodes become NOP
+static const uint8_t classes[256] = {
+#define INSTRUCTION(opc, op, mnemonic, am, l, cyc) \
+    [opc] = (MODE_##am == MODE_ACCUMULATOR && CLASS_##op == CLASS_RMW) ? CLASS_IMPLIED : CLASS_##op,
+#include "instruction_table.def"
+#undef INSTRUCTION
+};
+
+// run the operation of the current instruction, 'latched' passes the value
+// read earlier by a read-modify-write instruction
+static void operate(d6502_t *cpu, bool latched) {
+    if (cpu->trace) {
+        // the record carries the cycle the instruction started at
+        uint64_t cycles = cpu->cycles;
+        cpu->cycles -= cpu->cycle_pos - 1;
+        trace_record(cpu, cpu->cycle_irq);
+        cpu->cycles = cycles;
+    }
+    if (latched) {
+        // operations take immediate operands from cpu->operand
+        instruction_t rmw = *cpu->instruction;
+        rmw.mode = MODE_IMMEDIATE;
+        cpu->operand = cpu->m;
+        cpu->instruction = &rmw;
+        rmw.operation(cpu);
+        cpu->instruction = get_instruction(rmw.opcode);
+    } else {
+        cpu->instruction->operation(cpu);
+    }
+}
+
+// run the whole instruction at once, see above
+static void operate_at_once(d6502_t *cpu) {
+    bool nmi = cpu->nmi;
+    bool interrupt = cpu->interrupt;
+    if (!cpu->cycle_irq) {
+        // raised during the instruction, BRK must not see it yet
+        cpu->nmi = false;
+        cpu->interrupt = false;
+    }
+    addressing_modes[cpu->instruction->mode](cpu);
+    operate(cpu, false);
+    if (!cpu->cycle_irq) {
+        cpu->nmi |= nmi;
+        cpu->interrupt |= interrupt;
+    }
+}
+
+static void finish(d6502_t *cpu) {
+    cpu->pc += cpu->instruction->len;
+    cpu->instructions++;
+    if (!cpu->cycle_irq) {
+        // raised during this instruction, keep it pending
+    } else if (cpu->nmi) {
+        cpu->nmi = false;
+    } else if (cpu->interrupt) {
+        cpu->interrupt = false;
+    }
+    cpu->cycle_pos = 0;
+    cpu->st = get_status(cpu);
+}
+
+static void start(d6502_t *cpu) {
+    cpu->cycle_irq = cpu->nmi || cpu->interrupt;
+    cpu->extra_clocks = 0;
+    cpu->operand = 0;
+    cpu->cycle_data = 0;
+    if (cpu->cycle_irq) {
+        read8(cpu, cpu->pc); // opcode fetch is discarded
+        cpu->instruction = get_instruction(0x00); // BRK opcode
+    } else {
+        cpu->instruction = get_instruction(read8(cpu, cpu->pc));
+        if (cpu->instruction->operation == NULL) {
+            // illegal instruction -> perform NOP
+            cpu->instruction = get_instruction(0xEA);
+        }
+    }
+}
+
+// indexed modes: dummy read at the unfixed address before the access
+static void set_indexed(d6502_t *cpu, uint16_t base, uint8_t index, int cls, int pos) {
+    cpu->addr = base + index;
+    cpu->cycle_base = base;
+    bool crossed = PAGE_WRAP(base, cpu->addr);
+    if (cls != CLASS_READ || crossed) {
+        cpu->extra_clocks = cls == CLASS_READ;
+        cpu->cycle_data = pos + 2;
+    } else {
+        cpu->cycle_data = pos + 1;
+    }
+}
+
+// address phase, sets cpu->cycle_data once cpu->addr is complete
+static void address_step(d6502_t *cpu, int cls, int pos) {
+    uint16_t pc = cpu->pc;
+    switch (cpu->instruction->mode) {
+        case MODE_ZEROPAGE:
+            cpu->addr = cpu->operand = read8(cpu, pc + 1);
+            cpu->cycle_data = 3;
+            break;
+        case MODE_ZEROPAGE_X:
+        case MODE_ZEROPAGE_Y:
+            if (pos == 2) {
+                cpu->operand = read8(cpu, pc + 1);
+            } else {
+                read8(cpu, cpu->operand);
+                uint8_t index = cpu->instruction->mode == MODE_ZEROPAGE_X ? cpu->x : cpu->y;
+                cpu->addr = (uint8_t)(cpu->operand + index);
+                cpu->cycle_data = 4;
+            }
+            break;
+        case MODE_ABSOLUTE:
+        case MODE_ABSOLUTE_X:
+        case MODE_ABSOLUTE_Y:
+            if (pos == 2) {
+                cpu->operand = read8(cpu, pc + 1);
+            } else {
+                cpu->operand |= read8(cpu, pc + 2) << 8;
+                if (cpu->instruction->mode == MODE_ABSOLUTE) {
+                    cpu->addr = cpu->operand;
+                    cpu->cycle_data = 4;
+                } else {
+                    uint8_t index = cpu->instruction->mode == MODE_ABSOLUTE_X ? cpu->x : cpu->y;
+                    set_indexed(cpu, cpu->operand, index, cls, pos);
+                }
+            }
+            break;
+        case MODE_INDIRECT_X:
+            if (pos == 2) {
+                cpu->operand = read8(cpu, pc + 1);
+            } else if (pos == 3) {
+                read8(cpu, cpu->operand);
+            } else if (pos == 4) {
+                cpu->addr = read8(cpu, (uint8_t)(cpu->operand + cpu->x));
+            } else {
+                cpu->addr |= read8(cpu, (uint8_t)(cpu->operand + cpu->x + 1)) << 8;
+                cpu->cycle_data = 6;
+            }
+            break;
+        case MODE_INDIRECT_Y:
+            if (pos == 2) {
+                cpu->operand = read8(cpu, pc + 1);
+            } else if (pos == 3) {
+                cpu->addr = read8(cpu, cpu->operand);
+            } else {
+                uint16_t base = cpu->addr | read8(cpu, (uint8_t)(cpu->operand + 1)) << 8;
+                set_indexed(cpu, base, cpu->y, cls, pos);
+            }
+            break;
+    }
+}
+
+// data phase, 'n' counts from 0
+static bool data_step(d6502_t *cpu, int cls, int n) {
+    if (cls != CLASS_RMW) {
+        operate(cpu, false);
+        return true;
+    }
+    if (n == 0) {
+        cpu->m = read8(cpu, cpu->addr);
+    } else if (n == 1) {
+        write8(cpu, cpu->addr, cpu->m); // unmodified value
+    } else {
+        operate(cpu, true);
+        return true;
+    }
+    return false;
+}
+
+void cycle_step(d6502_t *cpu) {
+    int pos = ++cpu->cycle_pos;
+    bool done = false;
+    if (pos == 1) {
+        start(cpu);
+    }
+    const instruction_t *instruction = cpu->instruction;
+    int cls = cpu->cycle_irq ? CLASS_OTHER : classes[instruction->opcode];
+    switch (cls) {
+        case CLASS_IMPLIED:
+            if (pos == 2) {
+                read8(cpu, cpu->pc + 1);
+                operate(cpu, false);
+                done = true;
+            }
+            break;
+        case CLASS_READ:
+        case CLASS_WRITE:
+        case CLASS_RMW:
+            if (pos == 1) {
+                break;
+            }
+            if (instruction->mode == MODE_IMMEDIATE) {
+                cpu->operand = read8(cpu, cpu->pc + 1);
+                operate(cpu, false);
+                done = true;
+            } else if (cpu->cycle_data == 0) {
+                address_step(cpu, cls, pos);
+            } else if (pos < cpu->cycle_data) {
+                // page fixup
+                read8(cpu, (cpu->cycle_base & 0xff00) | (cpu->addr & 0xff));
+            } else {
+                done = data_step(cpu, cls, pos - cpu->cycle_data);
+            }
+            break;
+        default:
+            if (pos > 1 && pos < instruction->len + 1) {
+                cpu->operand |= read8(cpu, cpu->pc + pos - 1) << ((pos - 2) * 8);
+            }
+            if (pos == instruction->cycles) {
+                operate_at_once(cpu);
+            }
+            done = pos >= instruction->cycles + cpu->extra_clocks;
+            break;
+    }
+    cpu->cycles++;
+    if (done) {
+        finish(cpu);
+        cpu->current_cycle = 1;
+    } else {
+        cpu->current_cycle = instruction->cycles + cpu->extra_clocks - pos + 1;
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef __CYCLE_H
+#define __CYCLE_H
+
+#include "d6502.h"
+
+// does the bus access of the next clock cycle, starting a new instruction
+// if cpu->cycle_pos is 0. cpu->cycle_pos is 0 again after the last cycle.
+void cycle_step(d6502_t *cpu);
+
+#endif
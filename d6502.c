@@ -6,96 +6,356 @@
 #include "d6502_private.h"
 #include "operations.h"
 #include "instruction_table.h"
+#include "addressing.h"
+#include "switch_core.h"
+#include "threaded.h"
+#include "cycle.h"
 
-void set_flag(d6502_t *cpu, uint8_t status_mask, bool flag) {
-    cpu->st = flag ? cpu->st | status_mask : cpu->st & ~status_mask;
+uint16_t read16(d6502_t *cpu, uint16_t addr) {
+    return ((uint16_t)read8(cpu, addr)) | ((uint16_t)read8(cpu, addr+1) << 8);
 }
 
-bool get_flag(const d6502_t *cpu, uint8_t status_mask) {
-    return (cpu->st & status_mask) != 0;
+// decode:
+// read opcode and operand bytes at pc
+static void decode(d6502_t *cpu) {
+    cpu->instruction = get_instruction(read8(cpu, cpu->pc));
+    cpu->operand = 0;
+    if (cpu->instruction->len > 1) {
+        cpu->operand = read8(cpu, cpu->pc + 1);
+    }
+    if (cpu->instruction->len > 2) {
+        cpu->operand |= read8(cpu, cpu->pc + 2) << 8;
+    }
 }
 
-uint16_t read16(d6502_t *cpu, uint16_t addr) {
-    return ((uint16_t)cpu->read(addr)) | ((uint16_t)cpu->read(addr+1) << 8);
+// caches the decoded instruction at cpu->pc, if it is on immutable pages
+static void cache_decoded(d6502_t *cpu, d6502_decoded_t *e) {
+    // the operand bytes must be on an immutable page, too
+    uint16_t last = cpu->pc + (cpu->instruction->len ? cpu->instruction->len - 1 : 0);
+    if (cpu->page_flags[last >> 8] & D6502_PAGE_IMMUTABLE) {
+        cpu->page_flags[cpu->pc >> 8] |= D6502_PAGE_CACHED;
+        cpu->page_flags[last >> 8] |= D6502_PAGE_CACHED;
+        e->instruction = cpu->instruction;
+        e->pc = cpu->pc;
+        e->operand = cpu->operand;
+    }
+}
+
+static void decode_cached(d6502_t *cpu) {
+    d6502_decoded_t *e = &cpu->icache->entry[cpu->pc & (D6502_ICACHE_SIZE - 1)];
+    if (e->instruction && e->pc == cpu->pc) {
+        cpu->instruction = e->instruction;
+        cpu->operand = e->operand;
+        return;
+    }
+    decode(cpu);
+    cache_decoded(cpu, e);
+}
+
+void icache_prepare(d6502_t *cpu, uint16_t pc) {
+    if (!(cpu->page_flags[pc >> 8] & D6502_PAGE_IMMUTABLE)) {
+        return;
+    }
+    // decode() works on the cpu
+    uint16_t saved_pc = cpu->pc;
+    const instruction_t *saved_instruction = cpu->instruction;
+    uint16_t saved_operand = cpu->operand;
+    cpu->pc = pc;
+    decode(cpu);
+    cache_decoded(cpu, &cpu->icache->entry[pc & (D6502_ICACHE_SIZE - 1)]);
+    cpu->pc = saved_pc;
+    cpu->instruction = saved_instruction;
+    cpu->operand = saved_operand;
 }
 
 static void fetch(d6502_t *cpu) {
-    uint8_t opcode;
     if (cpu->nmi || cpu->interrupt) {
-        opcode = 0x00; // BRK opcode
+        cpu->instruction = get_instruction(0x00); // BRK opcode
+    } else if (cpu->icache && (cpu->page_flags[cpu->pc >> 8] & D6502_PAGE_IMMUTABLE)) {
+        decode_cached(cpu);
     } else {
-        opcode = cpu->read(cpu->pc);
+        decode(cpu);
     }
-    cpu->instruction = get_instruction(opcode);
 }
 
 // execute:
 // call addressing_mode(), execute instruction, move PC to next instruction
 static void execute(d6502_t *cpu) {
     cpu->extra_clocks = 0;
-    if (cpu->instruction->addressing == NULL) {
+    if (cpu->instruction->operation == NULL) {
         // illegal instruction -> perform NOP
         cpu->instruction = get_instruction(0xEA);
     }
-    cpu->instruction->addressing(cpu); // sets cpu->addr
-    if(!cpu->nmi && !cpu->interrupt) { // might skip output on race condition
-        //printf("%s %s\n", cpu->instruction->mnemonic, cpu->disassemble);
-    } else {
-        // printf("%s\n", cpu->nmi ? "NMI" : "interrupt");
-    }
-    
+    addressing_modes[cpu->instruction->mode](cpu); // sets cpu->addr
     cpu->instruction->operation(cpu);
     cpu->pc += cpu->instruction->len;
     cpu->current_cycle = cpu->instruction->cycles + cpu->extra_clocks;
+    cpu->cycles += cpu->current_cycle;
+    cpu->instructions++;
 }
 
 void d6502_init(d6502_t *cpu) {
-    initialize_instructions_sorted();
     cpu->instruction = get_instruction(0xEA); // NOP
     cpu->extra_clocks = 0;
     cpu->current_cycle = 0;
+    cpu->cycles = 0;
+    cpu->instructions = 0;
     cpu->nmi = false;
     cpu->interrupt = false;
+    cpu->halt = D6502_RUNNING;
+    cpu->engine = D6502_ENGINE_TABLE;
+    cpu->bus_mode = D6502_BUS_INSTRUCTION;
+    cpu->cycle_pos = 0;
+    cpu->userdata = NULL;
+    cpu->icache = NULL;
+    cpu->blocks = NULL;
+    cpu->bus_write = false;
+    cpu->trace = NULL;
+    cpu->watch = NULL;
+    cpu->profile = NULL;
+    cpu->event_count = 0;
+    cpu->next_event_id = 0;
+    d6502_unmap(cpu, 0, 256);
+    memset(cpu->page_flags, 0, sizeof(cpu->page_flags));
+    memset(cpu->dirty, 0, sizeof(cpu->dirty));
+}
+
+// step:
+// fetch and execute one whole instruction, acknowledge a serviced nmi/interrupt
+void step(d6502_t *cpu) {
+    bool serviced = cpu->nmi || cpu->interrupt;
+    uint16_t pc = cpu->pc;
+    fetch(cpu);
+    if (cpu->trace) {
+        trace_record(cpu, serviced);
+    }
+    execute(cpu);
+    if (cpu->profile) {
+        profile_record(cpu, pc, serviced);
+    }
+    if (!serviced) {
+        // raised by a bus callback during this instruction, keep it pending
+    } else if(cpu->nmi) {
+        cpu->nmi = false;
+    } else if(cpu->interrupt) {
+        cpu->interrupt = false;
+    }
+}
+
+static int tick_cycle(d6502_t *cpu) {
+    if (cpu->cycle_pos == 0) {
+        if (cpu->current_cycle == 1) {
+            // the tick after the last cycle of an instruction
+            cpu->current_cycle = 0;
+            return 0;
+        }
+        set_status(cpu, cpu->st); // unpack lazy flags
+        dispatch_events(cpu);
+        if (breakpoint(cpu)) {
+            return 0;
+        }
+    }
+    cycle_step(cpu);
+    return cpu->current_cycle;
 }
 
 int d6502_tick(d6502_t *cpu) {
+    if (cpu->halt) {
+        return 0;
+    }
+    if (cpu->bus_mode == D6502_BUS_CYCLE) {
+        return tick_cycle(cpu);
+    }
     if(cpu->current_cycle == 0) {
-        fetch(cpu);
-        execute(cpu);
-        if(cpu->nmi) {
-            cpu->nmi = false;
-        } else if(cpu->interrupt) {
-            cpu->interrupt = false;
+        set_status(cpu, cpu->st); // unpack lazy flags
+        dispatch_events(cpu);
+        if (breakpoint(cpu)) {
+            return 0;
         }
+        step(cpu);
+        cpu->st = get_status(cpu);
     } else {
         cpu->current_cycle--;
     }
     return cpu->current_cycle;
 }
 
+// run_engine:
+// execute whole instructions until at least 'cycles' have passed
+static int run_engine(d6502_t *cpu, int cycles) {
+    if (cpu->bus_mode == D6502_BUS_CYCLE) {
+        int done = 0;
+        while (done < cycles && !cpu->halt && !breakpoint(cpu)) {
+            do {
+                cycle_step(cpu);
+                done++;
+            } while (cpu->cycle_pos);
+        }
+        cpu->current_cycle = 0;
+        return done;
+    }
+    int done = 0;
+    if (cpu->watch && cpu->watch->breakpoints > 0) {
+        while (done < cycles && !cpu->halt && !breakpoint(cpu)) {
+            step(cpu);
+            done += cpu->current_cycle;
+            cpu->current_cycle = 0;
+        }
+        return done;
+    }
+    // only the table engine records a trace, the threaded engine does not
+    // profile the instructions of its blocks
+    if (cpu->engine == D6502_ENGINE_SWITCH && !cpu->trace) {
+        return switch_core_run(cpu, cycles);
+    }
+    if (cpu->engine == D6502_ENGINE_THREADED && cpu->blocks && !cpu->trace && !cpu->profile) {
+        return threaded_run(cpu, cycles);
+    }
+    while (done < cycles && !cpu->halt) {
+        step(cpu);
+        done += cpu->current_cycle;
+        cpu->current_cycle = 0;
+    }
+    return done;
+}
+
+int d6502_run(d6502_t *cpu, int cycles) {
+    // finish the instruction started by d6502_tick() first. Its first
+    // cycle was already counted by the tick that executed it.
+    int done = cpu->current_cycle > 0 ? cpu->current_cycle - 1 : 0;
+    if (cpu->cycle_pos) {
+        // per-cycle mode, do the remaining bus accesses
+        done = 0;
+        while (cpu->cycle_pos) {
+            cycle_step(cpu);
+            done++;
+        }
+    }
+    cpu->current_cycle = 0;
+    set_status(cpu, cpu->st); // unpack lazy flags
+    while (done < cycles && !cpu->halt) {
+        dispatch_events(cpu);
+        if (cpu->halt) {
+            break;
+        }
+        // run up to the next event
+        int budget = cycles - done;
+        if (cpu->event_count > 0 && cpu->events[0].when - cpu->cycles < (uint64_t)budget) {
+            budget = cpu->events[0].when - cpu->cycles;
+        }
+        done += run_engine(cpu, budget);
+    }
+    cpu->st = get_status(cpu);
+    return done;
+}
+
+uint64_t d6502_cycles(const d6502_t *cpu) {
+    return cpu->cycles;
+}
+
+uint64_t d6502_instructions(const d6502_t *cpu) {
+    return cpu->instructions;
+}
+
 void d6502_disassemble(d6502_t *cpu, uint16_t addr, char *asmcode) {
-    d6502_t tempcpu = *cpu;
-    tempcpu.pc = addr;
-    uint8_t opcode = cpu->read(tempcpu.pc);
-    tempcpu.instruction = get_instruction(opcode);
-    if( tempcpu.instruction->addressing) {
-        tempcpu.instruction->addressing(&tempcpu);
-        strcpy(asmcode, tempcpu.instruction->mnemonic);
+    uint8_t opcode = peek8(cpu, addr);
+    const instruction_t *instruction = get_instruction(opcode);
+    uint16_t operand = 0;
+    if (instruction->len > 1) {
+        operand = peek8(cpu, addr + 1);
+    }
+    if (instruction->len > 2) {
+        operand |= peek8(cpu, addr + 2) << 8;
+    }
+    d6502_disassemble_bytes(addr, opcode, operand, asmcode);
+}
+
+void d6502_disassemble_bytes(uint16_t pc, uint8_t opcode, uint16_t operand, char *asmcode) {
+    const instruction_t *instruction = get_instruction(opcode);
+    if (instruction->operation) {
+        int n = sprintf(asmcode, "%s ", get_mnemonic(instruction->opcode));
+        format_operand(instruction, pc, operand, asmcode + n);
     } else {
-        // undefined opcode -> perform NOP
-        tempcpu.instruction = get_instruction(0xEA);
-        strcpy(asmcode, "INVALD");
+        // undefined opcode
+        strcpy(asmcode, "INVALD ");
     }
-    strcat(strcat(asmcode, " "), tempcpu.disassemble);
 }
 
 void d6502_reset(d6502_t *cpu) {
     cpu->pc = read16(cpu, RESET_ADDR);
-    cpu->st = FLAG_I | FLAG_R;
+    set_status(cpu, FLAG_I | FLAG_R);
     cpu->a = 0;
     cpu->x = 0;
     cpu->y = 0;
     cpu->sp = 0xfd;
+    cpu->halt = D6502_RUNNING;
+    cpu->cycles += 7; // reset sequence
+}
+
+static void map(d6502_t *cpu, uint8_t first, int pages, const uint8_t *rd, uint8_t *wr) {
+    for (int i = 0; i < pages && first + i < 256; i++) {
+        cpu->read_page[first + i] = rd ? rd + i * 0x100 : NULL;
+        cpu->write_page[first + i] = wr ? wr + i * 0x100 : NULL;
+        if (cpu->watch) {
+            watch_map(cpu, first + i);
+        }
+    }
+    d6502_invalidate(cpu, first << 8, pages * 0x100);
+}
+
+void d6502_map_ram(d6502_t *cpu, uint8_t first, int pages, uint8_t *mem) {
+    map(cpu, first, pages, mem, mem);
+}
+
+void d6502_map_rom(d6502_t *cpu, uint8_t first, int pages, const uint8_t *mem) {
+    map(cpu, first, pages, mem, NULL);
+}
+
+void d6502_unmap(d6502_t *cpu, uint8_t first, int pages) {
+    map(cpu, first, pages, NULL, NULL);
+}
+
+void d6502_icache_attach(d6502_t *cpu, d6502_icache_t *cache) {
+    if (cache) {
+        memset(cache, 0, sizeof(*cache));
+    }
+    cpu->icache = cache;
+}
+
+void d6502_set_immutable(d6502_t *cpu, uint8_t first, int pages, bool immutable) {
+    for (int i = 0; i < pages && first + i < 256; i++) {
+        if (immutable) {
+            cpu->page_flags[first + i] |= D6502_PAGE_IMMUTABLE;
+        } else {
+            cpu->page_flags[first + i] &= ~D6502_PAGE_IMMUTABLE;
+        }
+    }
+    d6502_invalidate(cpu, first << 8, pages * 0x100);
+}
+
+void d6502_blocks_attach(d6502_t *cpu, d6502_block_cache_t *cache) {
+    if (cache) {
+        memset(cache, 0, sizeof(*cache));
+    }
+    cpu->blocks = cache;
+}
+
+void d6502_invalidate(d6502_t *cpu, uint16_t addr, int len) {
+    if (cpu->icache) {
+        for (int i = 0; i < D6502_ICACHE_SIZE; i++) {
+            d6502_decoded_t *e = &cpu->icache->entry[i];
+            // an instruction covers up to 3 bytes starting at its pc
+            if (e->instruction && (uint16_t)(e->pc - addr + 2) < len + 2) {
+                e->instruction = NULL;
+            }
+        }
+    }
+    threaded_invalidate(cpu, addr, len);
+}
+
+void invalidate_page(d6502_t *cpu, uint8_t page) {
+    cpu->page_flags[page] &= ~D6502_PAGE_CACHED;
+    d6502_invalidate(cpu, page << 8, 0x100);
 }
 
 void d6502_interrupt(d6502_t *cpu) {
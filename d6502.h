@@ -3,9 +3,20 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+// Thread safety: the core has no mutable global state. Every d6502_t is
+// independent, so separate instances may run on separate threads. A single
+// instance (and the bus behind its callbacks) must only be used by one
+// thread at a time. d6502_runner_create() runs jobs on a pool of threads.
 
 #define ENABLE_DECIMAL_MODE false
 
+// Keep N, Z, C and V unpacked while executing and only build the packed
+// status register when it is needed. cpu->st is exact whenever
+// d6502_tick()/d6502_run() return, but not inside bus callbacks.
+#define ENABLE_LAZY_FLAGS true
+
 #define NMI_ADDR   0xfffa
 #define RESET_ADDR 0xfffc
 #define INT_ADDR   0xfffe
@@ -13,15 +24,199 @@
 struct d6502_s;
 typedef struct d6502_s d6502_t;
 
+typedef enum {
+    D6502_RUNNING = 0,
+    D6502_HALT_END,     // END (illegal opcode 0xFF) executed
+    D6502_HALT_BREAK,   // stopped at a breakpoint, see d6502_watch()
+    D6502_HALT_WATCH    // a watched address was accessed, see d6502_watch()
+} d6502_halt_t;
+
+// when bus accesses happen, see cycle.c
+typedef enum {
+    D6502_BUS_INSTRUCTION = 0, // all accesses of an instruction on its first tick
+    D6502_BUS_CYCLE            // every access on its own clock cycle
+} d6502_bus_mode_t;
+
+// interpreter used by d6502_run(), d6502_tick() always uses the table engine
+typedef enum {
+    D6502_ENGINE_TABLE = 0, // opcode table with addressing/operation functions
+    D6502_ENGINE_SWITCH,    // fused switch, see switch_core.c
+    D6502_ENGINE_THREADED   // threaded code blocks, see threaded.c
+} d6502_engine_t;
+
+typedef enum {
+    MODE_IMPLIED,
+    MODE_ACCUMULATOR,
+    MODE_IMMEDIATE,
+    MODE_INDIRECT,
+    MODE_INDIRECT_X,
+    MODE_INDIRECT_Y,
+    MODE_ZEROPAGE,
+    MODE_ZEROPAGE_X,
+    MODE_ZEROPAGE_Y,
+    MODE_ABSOLUTE_X,
+    MODE_ABSOLUTE_Y,
+    MODE_ABSOLUTE,
+    MODE_RELATIVE
+} addressing_mode_t;
+
+// Entry of the opcode dispatch table, packed into 16 bytes. The mnemonic
+// lives in a separate table, see get_mnemonic().
 typedef struct {
-    uint8_t opcode;
-    const char *mnemonic;
+    void (*operation)(d6502_t *cpu); // NULL for undefined opcodes
+    uint8_t mode; // addressing_mode_t
     uint8_t len;
     uint8_t cycles;
-    void (*operation)(d6502_t *cpu);
-    void (*addressing)(d6502_t *cpu);
+    uint8_t opcode;
 } instruction_t;
 
+// entry of the decoded instruction cache
+typedef struct {
+    const instruction_t *instruction; // NULL: entry is empty
+    uint16_t pc;
+    uint16_t operand;
+} d6502_decoded_t;
+
+// Direct mapped cache of decoded instructions, indexed by the low bits of
+// the pc. Only instructions on immutable pages are cached.
+#define D6502_ICACHE_SIZE 4096
+
+typedef struct {
+    d6502_decoded_t entry[D6502_ICACHE_SIZE];
+} d6502_icache_t;
+
+// Threaded code block: a straight run of decoded instructions from
+// immutable pages. A block ends after a branch, jump, call, return, BRK
+// or END.
+#define D6502_BLOCK_MAX_LEN 16
+#define D6502_BLOCK_CACHE_SIZE 512
+
+typedef struct {
+    uint8_t opcode;
+    uint16_t operand;
+} d6502_threaded_op_t;
+
+typedef struct {
+    uint16_t end; // address after the last instruction
+    d6502_threaded_op_t op[D6502_BLOCK_MAX_LEN];
+} d6502_block_t;
+
+// kept apart from the blocks, looking up code which is not cached only
+// touches the tags
+typedef struct {
+    uint16_t pc; // start address
+    uint8_t count; // number of instructions, 0: entry is empty
+    uint8_t visits; // times pc was reached while the block was not built
+} d6502_block_tag_t;
+
+typedef struct {
+    d6502_block_tag_t tag[D6502_BLOCK_CACHE_SIZE];
+    d6502_block_t block[D6502_BLOCK_CACHE_SIZE];
+} d6502_block_cache_t;
+
+// Execution trace record, the cpu state before an instruction. The cycle
+// count is truncated to 32 bits, readers widen it again.
+typedef struct {
+    uint32_t cycles;
+    uint16_t pc;
+    uint16_t operand;
+    uint8_t opcode;
+    uint8_t a, x, y, p, sp;
+    uint8_t flags; // D6502_TRACE_*
+} d6502_trace_record_t;
+
+// trace record flags, a serviced nmi/interrupt is recorded as opcode 0
+#define D6502_TRACE_NMI 0x01 // serviced nmi, not a BRK
+#define D6502_TRACE_IRQ 0x02 // serviced interrupt, not a BRK
+
+// Ring buffer of the last 'size' executed instructions, see d6502_trace_attach()
+typedef struct {
+    d6502_trace_record_t *records;
+    uint32_t size; // number of records, power of two
+    uint64_t count; // number of instructions traced so far
+} d6502_trace_t;
+
+// Profiler, see d6502_profile_attach()
+#define D6502_PROFILE_DEPTH 64
+
+enum {
+    D6502_PROFILE_ROOT,
+    D6502_PROFILE_CALL, // JSR
+    D6502_PROFILE_BRK,
+    D6502_PROFILE_IRQ,
+    D6502_PROFILE_NMI
+};
+
+// node of the calling context tree, one per call path
+typedef struct {
+    uint16_t addr; // entry address
+    uint8_t kind; // D6502_PROFILE_*
+    int32_t parent; // node indices, -1: none
+    int32_t child; // first callee
+    int32_t sibling; // next callee of the parent
+    uint64_t calls;
+    uint64_t cycles; // exclusive, see d6502_profile_inclusive()
+} d6502_profile_node_t;
+
+typedef struct {
+    uint64_t count[0x10000]; // instructions executed per pc
+    uint64_t cycles[0x10000]; // cycles per pc
+    d6502_profile_node_t *nodes;
+    int max_nodes;
+    int node_count;
+    // current call path
+    struct {
+        int32_t node;
+        uint8_t sp; // stack pointer before the call
+    } frames[D6502_PROFILE_DEPTH];
+    int depth;
+} d6502_profile_t;
+
+// Scheduled event, see d6502_schedule()
+#define D6502_MAX_EVENTS 16
+
+typedef void (*d6502_event_fn)(d6502_t *cpu, void *arg);
+
+typedef struct {
+    uint64_t when; // d6502_cycles() value the event is due at
+    d6502_event_fn callback;
+    void *arg;
+    int id;
+} d6502_event_t;
+
+// page_flags bits
+#define D6502_PAGE_IMMUTABLE 0x01 // contents only change with d6502_invalidate()
+#define D6502_PAGE_CACHED    0x02 // decoded instructions from this page are cached
+#define D6502_PAGE_WATCH     0x04 // has read/write watches, direct pointers are in the watch
+#define D6502_PAGE_BREAK     0x08 // has breakpoints
+
+// watch kinds
+#define D6502_WATCH_READ  0x01
+#define D6502_WATCH_WRITE 0x02
+#define D6502_WATCH_EXEC  0x04 // breakpoint
+
+// Breakpoints and watchpoints, see d6502_watch()
+typedef struct {
+    uint8_t read[0x2000]; // one bit per address and kind
+    uint8_t write[0x2000];
+    uint8_t exec[0x2000];
+    uint16_t read_count[256]; // armed addresses per page
+    uint16_t write_count[256];
+    uint16_t exec_count[256];
+    int breakpoints;
+
+    // direct pointers of the D6502_PAGE_WATCH pages
+    const uint8_t *read_page[256];
+    uint8_t *write_page[256];
+
+    int32_t skip; // pc of the breakpoint to run over, -1: none
+
+    // first hit of the instruction which halted the cpu
+    uint16_t hit_addr;
+    uint8_t hit_kind; // D6502_WATCH_*
+    uint8_t hit_value; // value read or written
+} d6502_watch_t;
+
 struct d6502_s {
     uint8_t a;
     uint8_t x;
@@ -30,27 +225,459 @@ struct d6502_s {
     uint16_t pc;
     uint8_t sp;
 
+    // unpacked flags, only used with ENABLE_LAZY_FLAGS
+    uint8_t flag_n; // N is bit 7
+    uint8_t flag_z; // Z is set if flag_z is 0
+    uint8_t flag_c; // C is set if flag_c is not 0
+    uint8_t flag_v; // V is bit 7
+
     bool interrupt;
     bool nmi;
+    d6502_halt_t halt; // reason why the cpu stopped, cleared by d6502_reset()
+    d6502_engine_t engine; // set after d6502_init() to select the interpreter
+    d6502_bus_mode_t bus_mode; // set after d6502_init(), D6502_BUS_CYCLE overrides 'engine'
     
+    uint16_t operand; // operand bytes of the current instruction, set in fetch
     uint16_t addr; // address to read/write, set in addressing mode function
     uint8_t m; // temporary register, set in addressing mode function
     const instruction_t *instruction;
     uint8_t extra_clocks;
     uint8_t current_cycle; // counts ticks for current instruction
-    char disassemble[16];
+    // state of D6502_BUS_CYCLE mode
+    uint8_t cycle_pos; // cycles done of the current instruction, 0 between instructions
+    uint8_t cycle_data; // cycle of the first data access, 0 while addressing
+    uint16_t cycle_base; // unindexed address
+    bool cycle_irq; // the instruction services an nmi/interrupt
 
-    void (*write)(uint16_t addr, uint8_t dat);
-    uint8_t (*read)(uint16_t addr);
-};
+    uint64_t cycles; // total cycles, see d6502_cycles()
+    uint64_t instructions; // instructions retired, see d6502_instructions()
+
+    // bus callbacks, 'userdata' is passed through to every call
+    void (*write)(void *userdata, uint16_t addr, uint8_t dat);
+    uint8_t (*read)(void *userdata, uint16_t addr);
+    void *userdata;
+
+    // Page table for direct memory access, one entry per 256 byte page.
+    // Accesses to pages with a NULL entry go to the callbacks above.
+    // Set up with d6502_map_ram() / d6502_map_rom().
+    const uint8_t *read_page[256];
+    uint8_t *write_page[256];
+    uint8_t page_flags[256]; // D6502_PAGE_* bits
+    bool dirty[256]; // pages written since the last d6502_rewind_snapshot()
+
+    d6502_icache_t *icache; // decoded instruction cache, NULL if disabled
+    d6502_block_cache_t *blocks; // threaded code blocks, NULL if disabled
+    bool bus_write; // set when a write went to the write callback
+    d6502_trace_t *trace; // execution trace, NULL if disabled
+    d6502_watch_t *watch; // breakpoints and watchpoints, NULL if disabled
+    d6502_profile_t *profile; // profiler, NULL if disabled
 
-extern int EMULATION_END;
+    // pending events, a binary min-heap ordered by 'when'
+    d6502_event_t events[D6502_MAX_EVENTS];
+    int event_count;
+    int next_event_id;
+};
 
 void d6502_init(d6502_t *cpu);
+
+// d6502_tick() and d6502_run() do nothing while cpu->halt is set.
+// An instruction of N cycles takes N + 1 ticks: N ticks returning the
+// remaining cycles (> 0) and a tick returning 0. With D6502_BUS_INSTRUCTION
+// all bus accesses happen on the first tick, with D6502_BUS_CYCLE each tick
+// returning > 0 does the bus access of one clock cycle.
 int d6502_tick(d6502_t *cpu);
+
+// Executes whole instructions until at least 'cycles' clock cycles have
+// passed. Returns the number of cycles executed, which may overshoot
+// 'cycles' by up to one instruction. The cpu is left on an instruction
+// boundary (current_cycle == 0). Cycles are counted like the non-zero
+// return values of d6502_tick().
+int d6502_run(d6502_t *cpu, int cycles);
+// Total number of cycles executed since d6502_init(), including the 7
+// cycles of every d6502_reset(). An instruction is counted as a whole
+// when it executes: inside bus callbacks this is the cycle the current
+// instruction started at, and d6502_tick() counts all cycles of an
+// instruction on its first tick. With D6502_BUS_CYCLE every cycle is
+// counted when its bus access is done, so bus callbacks see the exact
+// cycle of the access.
+uint64_t d6502_cycles(const d6502_t *cpu);
+// number of instructions executed since d6502_init(), including serviced
+// interrupts
+uint64_t d6502_instructions(const d6502_t *cpu);
+
 void d6502_disassemble(d6502_t *cpu, uint16_t addr, char *asmcode);
+// disassembles an instruction from its bytes, without bus access
+void d6502_disassemble_bytes(uint16_t pc, uint8_t opcode, uint16_t operand, char *asmcode);
 void d6502_reset(d6502_t *cpu);
 void d6502_interrupt(d6502_t *cpu);
 void d6502_nmi(d6502_t *cpu);
 
+// Maps 'pages' pages of 256 bytes, starting at cpu address 'first' << 8,
+// directly to host memory 'mem'. Reads and writes of RAM pages and reads
+// of ROM pages are plain memory accesses. Writes to ROM pages still go to
+// the write callback (e.g. for mapper registers). d6502_unmap() sends the
+// pages back to the callbacks. Mirrors can be set up by mapping the same
+// memory several times.
+void d6502_map_ram(d6502_t *cpu, uint8_t first, int pages, uint8_t *mem);
+void d6502_map_rom(d6502_t *cpu, uint8_t first, int pages, const uint8_t *mem);
+void d6502_unmap(d6502_t *cpu, uint8_t first, int pages);
+
+// Decoded instruction cache. Opcode and operand bytes of instructions on
+// pages marked immutable are decoded once and then taken from the cache.
+// The cache is used by the table engine.
+void d6502_icache_attach(d6502_t *cpu, d6502_icache_t *cache);
+
+// Threaded code blocks, needed for D6502_ENGINE_THREADED.
+void d6502_blocks_attach(d6502_t *cpu, d6502_block_cache_t *cache);
+
+// Only code on immutable pages is cached. Writes to an immutable page
+// through the write callback drop the cached code of that page. Besides
+// that, the host must call d6502_invalidate() when the memory behind an
+// immutable page changes, e.g. on a mapper bank switch done outside of
+// d6502_map_*(). Remapping pages with d6502_map_*() invalidates them
+// automatically. Immutable pages should not be mapped with d6502_map_ram().
+void d6502_set_immutable(d6502_t *cpu, uint8_t first, int pages, bool immutable);
+void d6502_invalidate(d6502_t *cpu, uint16_t addr, int len);
+
+// Execution trace. Every executed instruction is recorded into the ring
+// buffer 'records' of 'size' entries (a power of two), older records are
+// overwritten. Pass NULL to stop tracing. The records carry the value of
+// d6502_cycles(). While tracing, d6502_run() uses the table engine.
+// d6502_trace_save() writes the records oldest first, the file format is
+// described in trace.c. tracedump renders such a file as nestest log text.
+void d6502_trace_attach(d6502_t *cpu, d6502_trace_t *trace, d6502_trace_record_t *records, uint32_t size);
+bool d6502_trace_save(const d6502_trace_t *trace, const char *fn);
+
+// Profiler. Counts the instructions and cycles of every pc and builds a
+// calling context tree of JSR calls, BRK and interrupt handlers in 'nodes'
+// (max_nodes >= 1, node 0 is the root). Calls beyond D6502_PROFILE_DEPTH
+// or max_nodes are counted in their caller. Pass NULL to stop profiling.
+// While profiling, d6502_run() uses the table engine in place of the
+// threaded one, D6502_BUS_CYCLE is not profiled. d6502_profile_save()
+// writes the tree as folded stacks ("$C000;$C72D;nmi $C5F5 1234" per
+// line, exclusive cycles) for flame graph tools.
+void d6502_profile_attach(d6502_t *cpu, d6502_profile_t *profile, d6502_profile_node_t *nodes, int max_nodes);
+uint64_t d6502_profile_inclusive(const d6502_profile_t *profile, int node);
+bool d6502_profile_save(const d6502_profile_t *profile, const char *fn);
+
+// Breakpoints and watchpoints. d6502_watch() arms ('armed' true) or
+// disarms the D6502_WATCH_* 'kinds' for addr..addr+len-1, any number of
+// addresses can be armed. A breakpoint halts the cpu with D6502_HALT_BREAK
+// before the instruction at its address executes. A watched read or write
+// lets the instruction finish and then halts the cpu with
+// D6502_HALT_WATCH. Watches see every bus access, also pointer, stack and
+// instruction fetches. The hit is stored in the watch. To continue, set
+// cpu->halt to D6502_RUNNING, a breakpoint the cpu stopped at is run over
+// once. Pages without armed addresses run at full speed.
+void d6502_watch_attach(d6502_t *cpu, d6502_watch_t *watch);
+void d6502_watch(d6502_t *cpu, uint16_t addr, int len, uint8_t kinds, bool armed);
+
+// CPU state snapshots. The blob holds the registers, pending nmi/interrupt,
+// the halt reason, the cycle and instruction counters and the state of an
+// instruction in flight (d6502_tick() or D6502_BUS_CYCLE), in a versioned
+// little endian format of D6502_STATE_SIZE bytes. Memory, callbacks, page
+// table, caches, trace and events belong to the host and are not saved.
+// d6502_save_state() returns the number of bytes written, 0 if 'size' is
+// too small. d6502_load_state() returns false for blobs of another version
+// and for damaged blobs with out of range values, the cpu is unchanged then.
+#define D6502_STATE_SIZE 40
+int d6502_save_state(const d6502_t *cpu, uint8_t *buf, int size);
+bool d6502_load_state(d6502_t *cpu, const uint8_t *buf, int size);
+
+// rewind snapshot, see rewind.c
+typedef struct {
+    uint8_t state[D6502_STATE_SIZE];
+    uint32_t first; // first delta page in the pool
+    uint32_t count; // number of delta pages
+} d6502_rewind_snapshot_t;
+
+typedef struct {
+    uint8_t *mem; // host memory of the whole address space
+    uint8_t shadow[0x10000]; // memory at the newest snapshot
+    bool dirty[256]; // pages reported with d6502_rewind_touch()
+
+    d6502_rewind_snapshot_t *snapshots; // ring of 'max_snapshots'
+    int max_snapshots;
+    uint32_t oldest; // counts up, index modulo max_snapshots
+    int snapshot_count;
+
+    uint8_t (*pool)[256]; // ring of 'pool_size' delta pages
+    uint8_t *pool_page; // page number of each pool entry
+    uint32_t pool_size;
+    uint32_t pool_head; // next free entry, counts up
+    uint32_t pool_tail; // oldest used entry, counts up
+} d6502_rewind_t;
+
+// Rewind buffer. Keeps up to 'snapshots' snapshots of the cpu state and
+// 'mem', the host memory behind the whole 64KB address space (as in
+// sim.c). Only pages written since the previous snapshot are stored, as
+// the contents they had before, in a pool of 'pool_pages' pages (at least
+// 256). Old snapshots are dropped when the ring or the pool is full.
+// The pages written by the cpu are taken from cpu->dirty, so all bus
+// accesses stay direct; pages mapped with d6502_map_ram() must map 'mem'
+// at their cpu address. Changes of 'mem' by the host must be reported
+// with d6502_rewind_touch().
+// d6502_rewind_restore() goes back to the snapshot 'back' steps before the
+// newest (0: the newest) and drops all newer ones. Events are not part of
+// a snapshot.
+bool d6502_rewind_init(d6502_rewind_t *rw, uint8_t *mem, int snapshots, int pool_pages);
+void d6502_rewind_free(d6502_rewind_t *rw);
+void d6502_rewind_touch(d6502_rewind_t *rw, uint16_t addr, int len);
+void d6502_rewind_snapshot(d6502_t *cpu, d6502_rewind_t *rw);
+bool d6502_rewind_restore(d6502_t *cpu, d6502_rewind_t *rw, int back);
+
+// Event queue. 'callback' is called with 'arg' at the first instruction
+// boundary at which d6502_cycles() >= 'when'. d6502_run() executes at full
+// speed up to the next deadline, so events are late by less than one
+// instruction. Callbacks may schedule further events, raise interrupts or
+// set cpu->halt. Returns an id for d6502_cancel(), or -1 if the queue is
+// full.
+int d6502_schedule(d6502_t *cpu, uint64_t when, d6502_event_fn callback, void *arg);
+// shorthands for events which call d6502_interrupt() / d6502_nmi()
+int d6502_schedule_interrupt(d6502_t *cpu, uint64_t when);
+int d6502_schedule_nmi(d6502_t *cpu, uint64_t when);
+// removes a pending event, returns false if it already ran
+bool d6502_cancel(d6502_t *cpu, int id);
+
+// Lockstep group of cpus running the same program, e.g. for fuzzing with
+// different inputs. While d6502_group_run() runs, the registers of all
+// instances are kept in the group in structure of arrays form. Instances
+// at the same pc execute the instruction together, see group.c.
+#define D6502_GROUP_MAX 64
+
+typedef struct {
+    int count;
+    d6502_t *cpu[D6502_GROUP_MAX];
+
+    // registers of every instance
+    uint8_t a[D6502_GROUP_MAX];
+    uint8_t x[D6502_GROUP_MAX];
+    uint8_t y[D6502_GROUP_MAX];
+    uint8_t sp[D6502_GROUP_MAX];
+    uint16_t pc[D6502_GROUP_MAX];
+    uint8_t p[D6502_GROUP_MAX]; // I, D, B and R
+    uint8_t n[D6502_GROUP_MAX]; // unpacked N, Z, C and V as in d6502_t
+    uint8_t z[D6502_GROUP_MAX];
+    uint8_t c[D6502_GROUP_MAX];
+    uint8_t v[D6502_GROUP_MAX];
+    uint64_t cycles[D6502_GROUP_MAX]; // counters at the start of the run
+    uint64_t instructions[D6502_GROUP_MAX];
+    int done[D6502_GROUP_MAX]; // cycles executed in this run
+    int executed[D6502_GROUP_MAX]; // instructions executed in this run
+    int until[D6502_GROUP_MAX]; // runs in lockstep while done < until
+
+    // state of the current instruction
+    uint8_t active[D6502_GROUP_MAX]; // instance executes the instruction
+    uint16_t addr[D6502_GROUP_MAX];
+    uint8_t m[D6502_GROUP_MAX];
+    uint8_t r[D6502_GROUP_MAX];
+    uint8_t extra[D6502_GROUP_MAX];
+
+    uint64_t lockstep; // instructions executed in lockstep
+    uint64_t scalar; // instructions executed one instance at a time
+} d6502_group_t;
+
+// Every instance keeps its own memory, callbacks and page table. Code runs
+// in lockstep only from immutable pages, all instances must have the same
+// pages marked immutable and the same program in them. d6502_group_run()
+// runs every instance until at least 'cycles' cycles have passed for it,
+// like d6502_run(). Scheduled events are dispatched on time. The registers
+// and counters in the d6502_t of an instance are only exact when
+// d6502_group_run() returns, not inside its bus callbacks.
+void d6502_group_init(d6502_group_t *g);
+bool d6502_group_add(d6502_group_t *g, d6502_t *cpu); // false if full
+void d6502_group_run(d6502_group_t *g, int cycles);
+
+// Job runner, runs independent sessions on a pool of worker threads, see
+// runner.c. A job loads 'image' at 'image_addr' into 64KB of otherwise
+// zeroed RAM, resets the cpu and runs it for 'cycles' cycles or until it
+// halts. With 'rom' the pages of the image are read-only and immutable
+// (writes are ignored), so the threaded engine can be used. 'start' >= 0
+// replaces the reset vector. The input script writes 'value' to 'addr'
+// once d6502_cycles() reaches 'when', entries sorted by 'when'.
+typedef struct {
+    uint64_t when;
+    uint16_t addr;
+    uint8_t value;
+} d6502_input_t;
+
+struct d6502_job_result_s;
+
+typedef struct {
+    const uint8_t *image;
+    uint16_t image_addr;
+    int image_size;
+    bool rom;
+    int32_t start;
+    d6502_engine_t engine;
+    const d6502_input_t *inputs;
+    int input_count;
+    uint64_t cycles;
+    // called on the worker thread when the job is done
+    void (*done)(const struct d6502_job_result_s *result);
+    void *userdata;
+} d6502_job_t;
+
+// valid during the 'done' callback only
+typedef struct d6502_job_result_s {
+    const d6502_job_t *job;
+    const d6502_t *cpu; // registers, counters and halt reason at the end
+    const uint8_t *memory; // the 64KB at the end
+    const d6502_trace_t *trace; // last instructions, NULL without trace
+    int worker;
+} d6502_job_result_t;
+
+typedef struct d6502_runner_s d6502_runner_t;
+
+// Starts 'threads' workers. With 'trace_size' > 0 (a power of two) every
+// job keeps a trace of its last 'trace_size' instructions. Returns NULL
+// on failure or if 'trace_size' is not 0 or a power of two.
+d6502_runner_t *d6502_runner_create(int threads, uint32_t trace_size);
+// Queues a copy of 'job'. Image and inputs must stay valid until the job
+// is done. Returns false if out of memory, if 'image_size' is negative,
+// 'image' is NULL with a nonzero 'image_size' or 'start' is above 0xFFFF.
+bool d6502_runner_submit(d6502_runner_t *r, const d6502_job_t *job);
+// waits until all submitted jobs are done
+void d6502_runner_wait(d6502_runner_t *r);
+// runs the queued jobs, then stops the workers
+void d6502_runner_destroy(d6502_runner_t *r);
+
+// one decoded instruction
+typedef struct {
+    uint16_t addr;
+    uint8_t bytes[3]; // 'len' bytes, the rest is 0
+    uint8_t len; // 1 for undefined opcodes
+    uint8_t opcode;
+    uint8_t mode; // addressing_mode_t
+    bool valid; // false for undefined opcodes and instructions cut off at the end
+    uint16_t operand; // 8 or 16 bit operand
+    int32_t target; // branch, JMP or JSR destination, -1 for others
+    const char *mnemonic; // "" for undefined opcodes
+} d6502_disasm_t;
+
+// Decodes 'size' bytes at 'buf' as code at 'addr' into records, from the
+// first byte on, and returns the number of records. 'out' must have room
+// for 'size' records. Buffers of 32KB and more are split into chunks of
+// at least 16KB on up to 'threads' threads, no more than there are cores.
+// Needs no cpu and may be called from any thread.
+int d6502_disassemble_buffer(const uint8_t *buf, int size, uint16_t addr, d6502_disasm_t *out, int threads);
+// same for 'size' bytes of the memory of 'cpu', read like
+// d6502_disassemble(). Returns -1 if out of memory.
+int d6502_disassemble_range(d6502_t *cpu, uint16_t addr, int size, d6502_disasm_t *out, int threads);
+// Formats records as lines like "C000  4C F5 C5  JMP $C5F5" into 'buf' of
+// 'size' bytes, 0 terminated. Returns the number of records written, less
+// than 'count' if 'buf' is full.
+int d6502_disassemble_text(const d6502_disasm_t *records, int count, char *buf, int size);
+
+// Static analysis of a ROM image, see d6502_analyze(). Flags per address:
+#define D6502_MAP_CODE     0x01 // first byte of a reachable instruction
+#define D6502_MAP_OPERAND  0x02 // operand byte of a reachable instruction
+#define D6502_MAP_DATA     0x04 // byte of the image which is not code
+#define D6502_MAP_BLOCK    0x08 // start of a basic block
+#define D6502_MAP_SUB      0x10 // subroutine entry (JSR target or vector)
+#define D6502_MAP_SUB_END  0x20 // last instruction of a subroutine
+#define D6502_MAP_TARGET   0x40 // branch or jump target
+#define D6502_MAP_VECTOR   0x80 // reset, nmi or irq entry
+
+// cross reference kinds
+enum {
+    D6502_XREF_BRANCH,
+    D6502_XREF_JUMP, // JMP absolute
+    D6502_XREF_CALL, // JSR
+    D6502_XREF_VECTOR // 'from' is the vector address
+};
+
+typedef struct {
+    uint16_t from;
+    uint16_t to;
+    uint8_t kind;
+} d6502_xref_t;
+
+typedef struct {
+    uint8_t flags[0x10000];
+    d6502_xref_t *xrefs; // sorted by 'to', then 'from'
+    int max_xrefs;
+    int xref_count;
+    uint32_t hash; // of the image, to match saved maps
+} d6502_analysis_t;
+
+// Recursive descent analysis of the code in 'size' bytes at 'buf', mapped
+// at 'addr'. Starts at the reset, nmi and irq vectors when the image holds
+// them and at 'entries', and follows branches, JMP absolute, JSR and the
+// RTS trick (LDA #hi, PHA, LDA #lo, PHA, RTS) within the image. JMP
+// indirect, RTS, RTI, BRK, END and undefined opcodes end a path. 'xrefs'
+// has room for 'max_xrefs' cross references, further ones are dropped.
+// Returns false if out of memory.
+bool d6502_analyze(d6502_analysis_t *a, const uint8_t *buf, int size, uint16_t addr,
+    const uint16_t *entries, int entry_count, d6502_xref_t *xrefs, int max_xrefs);
+// Number of cross references to 'to', '*refs' points to the first one.
+int d6502_analysis_refs(const d6502_analysis_t *a, uint16_t to, const d6502_xref_t **refs);
+// Writes a label like "reset", "sub_C5F5" or "L_C72D" to 's' (at least 10
+// bytes) and returns true if 'addr' has one.
+bool d6502_analysis_label(const d6502_analysis_t *a, uint16_t addr, char *s);
+// Persistent map. d6502_analysis_load() returns false if the file is
+// missing, damaged, was made from another image or has more than
+// 'max_xrefs' cross references, 'xrefs' is like in d6502_analyze().
+bool d6502_analysis_save(const d6502_analysis_t *a, const char *fn);
+bool d6502_analysis_load(d6502_analysis_t *a, const char *fn, const uint8_t *buf, int size, uint16_t addr,
+    d6502_xref_t *xrefs, int max_xrefs);
+// Decodes the basic blocks found by the analysis into the attached
+// decoded instruction cache and threaded block cache, so they are not
+// discovered while running. Only code on immutable pages is cached.
+void d6502_analysis_seed(d6502_t *cpu, const d6502_analysis_t *a);
+
+// ROM file, see d6502_rom_open()
+enum {
+    D6502_MIRROR_HORIZONTAL,
+    D6502_MIRROR_VERTICAL,
+    D6502_MIRROR_FOUR_SCREEN
+};
+
+enum {
+    D6502_TIMING_NTSC,
+    D6502_TIMING_PAL,
+    D6502_TIMING_MULTI,
+    D6502_TIMING_DENDY
+};
+
+typedef struct {
+    const uint8_t *data; // the whole file
+    size_t size;
+    bool mapped; // 'data' is mapped by d6502_rom_open()
+    bool nes2; // NES 2.0 header, else iNES
+    uint16_t mapper;
+    uint8_t submapper; // NES 2.0 only
+    uint8_t mirroring;
+    uint8_t timing;
+    uint8_t console; // 0: NES, 1: Vs. System, 2: PlayChoice-10, 3: extended
+    bool battery;
+    const uint8_t *trainer; // 512 bytes, NULL if none
+    const uint8_t *prg;
+    uint64_t prg_size;
+    const uint8_t *chr; // NULL if the board has CHR RAM
+    uint64_t chr_size;
+    const uint8_t *misc; // data after CHR, NULL if none
+    uint64_t misc_size;
+    uint32_t prg_ram_size;
+    uint32_t prg_nvram_size;
+    uint32_t chr_ram_size;
+    uint32_t chr_nvram_size;
+} d6502_rom_t;
+
+// Maps an iNES or NES 2.0 file read-only into memory and parses its header.
+// PRG, CHR and trainer point into the mapping, nothing is copied. Returns
+// false if the file cannot be mapped, is no iNES file or is shorter than
+// its header says.
+bool d6502_rom_open(d6502_rom_t *rom, const char *fn);
+// same for a file already in memory, 'data' must outlive 'rom'
+bool d6502_rom_parse(d6502_rom_t *rom, const uint8_t *data, size_t size);
+void d6502_rom_close(d6502_rom_t *rom);
+// Bank 'bank' of 'bank_size' bytes, NULL if it is outside PRG/CHR.
+const uint8_t *d6502_rom_prg_bank(const d6502_rom_t *rom, int bank, uint32_t bank_size);
+const uint8_t *d6502_rom_chr_bank(const d6502_rom_t *rom, int bank, uint32_t bank_size);
+// Maps PRG bank 'bank' of 'bank_size' bytes (a multiple of 256) as
+// immutable ROM pages from cpu address 'first' << 8 on, see
+// d6502_map_rom(). Returns false if there is no such bank.
+bool d6502_rom_map_prg(d6502_t *cpu, const d6502_rom_t *rom, uint8_t first, int bank, uint32_t bank_size);
+
 #endif
\ No newline at end of file
@@ -14,11 +14,163 @@ typedef enum {
     FLAG_N = 0x80  // sign flag
 } flags_t;
 
-uint8_t read(d6502_t *cpu, uint16_t addr);
+void invalidate_page(d6502_t *cpu, uint8_t page);
+// adds the instruction at pc to cpu->icache, if it is on immutable pages
+void icache_prepare(d6502_t *cpu, uint16_t pc);
+
+// fetch and execute one whole instruction
+void step(d6502_t *cpu);
+
+// adds the current instruction to cpu->trace, 'serviced' if it is an
+// nmi/interrupt
+void trace_record(d6502_t *cpu, bool serviced);
+
+// adds the instruction just executed at 'pc' to cpu->profile,
+// 'serviced' if it was an nmi/interrupt
+void profile_record(d6502_t *cpu, uint16_t pc, bool serviced);
+
+// runs all events which are due
+void dispatch_events(d6502_t *cpu);
+
+// slow paths of D6502_PAGE_WATCH / D6502_PAGE_BREAK pages, see watch.c
+uint8_t watch_read(d6502_t *cpu, uint16_t addr);
+void watch_write(d6502_t *cpu, uint16_t addr, uint8_t dat);
+bool watch_break(d6502_t *cpu);
+// moves new direct pointers of a D6502_PAGE_WATCH page into the watch
+void watch_map(d6502_t *cpu, uint8_t page);
+// reads without triggering watches
+uint8_t peek8(d6502_t *cpu, uint16_t addr);
+
+static inline uint8_t read8(d6502_t *cpu, uint16_t addr) {
+    const uint8_t *page = cpu->read_page[addr >> 8];
+    if (page) {
+        return page[addr & 0xff];
+    }
+    if (cpu->page_flags[addr >> 8] & D6502_PAGE_WATCH) {
+        return watch_read(cpu, addr);
+    }
+    return cpu->read(cpu->userdata, addr);
+}
+
+static inline void write8(d6502_t *cpu, uint16_t addr, uint8_t dat) {
+    uint8_t *page = cpu->write_page[addr >> 8];
+    cpu->dirty[addr >> 8] = true;
+    if (page) {
+        page[addr & 0xff] = dat;
+    } else if (cpu->page_flags[addr >> 8] & D6502_PAGE_WATCH) {
+        watch_write(cpu, addr, dat);
+    } else {
+        if (cpu->page_flags[addr >> 8] & D6502_PAGE_CACHED) {
+            invalidate_page(cpu, addr >> 8);
+        }
+        cpu->bus_write = true;
+        cpu->write(cpu->userdata, addr, dat);
+    }
+}
+
 uint16_t read16(d6502_t *cpu, uint16_t addr);
-void write(d6502_t *cpu, uint16_t addr, uint8_t dat);
 
-void set_flag(d6502_t *cpu, uint8_t status_mask, bool flag);
-bool get_flag(const d6502_t *cpu, uint8_t status_mask);
+// true if the cpu halted at a breakpoint at pc
+static inline bool breakpoint(d6502_t *cpu) {
+    return (cpu->page_flags[cpu->pc >> 8] & D6502_PAGE_BREAK) && watch_break(cpu);
+}
+
+// little endian serialization
+static inline void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static inline void put64(uint8_t *p, uint64_t v) {
+    put32(p, v);
+    put32(p + 4, v >> 32);
+}
+
+static inline uint16_t get16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static inline uint64_t get64(const uint8_t *p) {
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+// With ENABLE_LAZY_FLAGS, N, Z, C and V live unpacked in flag_n, flag_z,
+// flag_c and flag_v while instructions execute. cpu->st then only holds
+// I, D, B and R until get_status() packs them again. d6502_tick() and
+// d6502_run() unpack cpu->st on entry and pack it on return.
+
+static inline void set_flag(d6502_t *cpu, uint8_t status_mask, bool flag) {
+    if (ENABLE_LAZY_FLAGS) {
+        switch (status_mask) {
+            case FLAG_N: cpu->flag_n = flag ? 0x80 : 0; return;
+            case FLAG_Z: cpu->flag_z = !flag; return;
+            case FLAG_C: cpu->flag_c = flag; return;
+            case FLAG_V: cpu->flag_v = flag ? 0x80 : 0; return;
+        }
+    }
+    cpu->st = flag ? cpu->st | status_mask : cpu->st & ~status_mask;
+}
+
+static inline bool get_flag(const d6502_t *cpu, uint8_t status_mask) {
+    if (ENABLE_LAZY_FLAGS) {
+        switch (status_mask) {
+            case FLAG_N: return (cpu->flag_n & 0x80) != 0;
+            case FLAG_Z: return cpu->flag_z == 0;
+            case FLAG_C: return cpu->flag_c != 0;
+            case FLAG_V: return (cpu->flag_v & 0x80) != 0;
+        }
+    }
+    return (cpu->st & status_mask) != 0;
+}
+
+// sets N and Z from a result
+static inline void set_nz(d6502_t *cpu, uint8_t v) {
+    if (ENABLE_LAZY_FLAGS) {
+        cpu->flag_n = v;
+        cpu->flag_z = v;
+    } else {
+        cpu->st = (cpu->st & ~(FLAG_N | FLAG_Z)) | (v & FLAG_N) | (v ? 0 : FLAG_Z);
+    }
+}
+
+// sets V from bit 7 of v
+static inline void set_overflow(d6502_t *cpu, uint8_t v) {
+    if (ENABLE_LAZY_FLAGS) {
+        cpu->flag_v = v;
+    } else {
+        set_flag(cpu, FLAG_V, v & 0x80);
+    }
+}
+
+// packed status register
+static inline uint8_t get_status(const d6502_t *cpu) {
+    if (!ENABLE_LAZY_FLAGS) {
+        return cpu->st;
+    }
+    return (cpu->st & ~(FLAG_N | FLAG_Z | FLAG_C | FLAG_V))
+        | (cpu->flag_n & FLAG_N)
+        | (cpu->flag_z ? 0 : FLAG_Z)
+        | (cpu->flag_c ? FLAG_C : 0)
+        | ((cpu->flag_v & 0x80) ? FLAG_V : 0);
+}
+
+static inline void set_status(d6502_t *cpu, uint8_t st) {
+    cpu->st = st;
+    if (ENABLE_LAZY_FLAGS) {
+        cpu->flag_n = st;
+        cpu->flag_z = ~st & FLAG_Z;
+        cpu->flag_c = st & FLAG_C;
+        cpu->flag_v = st << 1;
+    }
+}
 
 #endif
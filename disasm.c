@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+
+// Bulk disassembler. Decodes a byte buffer linearly from its first byte
+// into one record per instruction, without a cpu and without formatting.
+//
+// With several threads the buffer is cut into chunks. Every thread decodes
+// its chunk from the chunk start and stores each record at the offset of
+// its first byte, so out[] is indexed by offset while decoding. A chunk
+// start can be in the middle of an instruction of the linear decode, but
+// decoding is a function of the offset only: the final walk from offset 0
+// takes the records at the offsets it reaches, decodes the few offsets no
+// thread has reached (len == 0) and packs the records to the front.
+
+// below this, a chunk is not worth a thread: creating and joining one
+// costs about 20us, as long as decoding 2KB
+#define CHUNK_MIN 0x4000
+
+#define OP_JSR 0x20
+#define OP_JMP 0x4C
+
+typedef struct {
+    const uint8_t *buf;
+    int size;
+    uint16_t addr;
+    d6502_disasm_t *out;
+    int first; // chunk [first, last)
+    int last;
+    pthread_t thread;
+} chunk_t;
+
+static void decode(const uint8_t *buf, int size, uint16_t addr, int offset, d6502_disasm_t *d) {
+    uint8_t opcode = buf[offset];
+    const instruction_t *instruction = get_instruction(opcode);
+    int len = instruction->operation ? instruction->len : 1;
+    d->valid = instruction->operation != NULL;
+    if (len > size - offset) {
+        // cut off by the end of the buffer
+        len = size - offset;
+        d->valid = false;
+    }
+    d->addr = addr + offset;
+    d->len = len;
+    d->opcode = opcode;
+    d->mode = instruction->mode;
+    d->mnemonic = get_mnemonic(opcode);
+    d->operand = 0;
+    d->target = -1;
+    for (int i = 0; i < 3; i++) {
+        d->bytes[i] = i < len ? buf[offset + i] : 0;
+    }
+    if (!d->valid) {
+        return;
+    }
+    if (len > 1) {
+        d->operand = d->bytes[1];
+    }
+    if (len > 2) {
+        d->operand |= d->bytes[2] << 8;
+    }
+    if (instruction->mode == MODE_RELATIVE) {
+        d->target = (uint16_t)(d->addr + 2 + (int8_t)d->bytes[1]);
+    } else if (opcode == OP_JSR || opcode == OP_JMP) {
+        d->target = d->operand;
+    }
+}
+
+static void *decode_chunk(void *arg) {
+    chunk_t *c = arg;
+    for (int i = c->first; i < c->last; i++) {
+        c->out[i].len = 0;
+    }
+    for (int i = c->first; i < c->last; i += c->out[i].len) {
+        decode(c->buf, c->size, c->addr, i, &c->out[i]);
+    }
+    return NULL;
+}
+
+int d6502_disassemble_buffer(const uint8_t *buf, int size, uint16_t addr, d6502_disasm_t *out, int threads) {
+    if (size <= 0) {
+        return 0;
+    }
+    if (threads > size / CHUNK_MIN) {
+        threads = size / CHUNK_MIN;
+    }
+    // more threads than cores only add their start up
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > 0 && threads > cores) {
+        threads = cores;
+    }
+    if (threads > 1) {
+        chunk_t *chunks = malloc(threads * sizeof(chunk_t));
+        if (chunks == NULL) {
+            threads = 1;
+        } else {
+            for (int t = 0; t < threads; t++) {
+                chunks[t] = (chunk_t){ buf, size, addr, out, (int64_t)size * t / threads, (int64_t)size * (t + 1) / threads };
+            }
+            // the first chunk is decoded on this thread
+            int started = 1;
+            while (started < threads && pthread_create(&chunks[started].thread, NULL, decode_chunk, &chunks[started]) == 0) {
+                started++;
+            }
+            decode_chunk(&chunks[0]);
+            for (int t = started; t < threads; t++) {
+                // out of threads
+                decode_chunk(&chunks[t]);
+            }
+            for (int t = 1; t < started; t++) {
+                pthread_join(chunks[t].thread, NULL);
+            }
+            free(chunks);
+        }
+    }
+    int n = 0;
+    for (int i = 0; i < size; ) {
+        if (threads <= 1 || out[i].len == 0) {
+            decode(buf, size, addr, i, &out[i]);
+        }
+        int len = out[i].len;
+        // n <= i, so records not yet walked are not overwritten
+        out[n++] = out[i];
+        i += len;
+    }
+    return n;
+}
+
+int d6502_disassemble_range(d6502_t *cpu, uint16_t addr, int size, d6502_disasm_t *out, int threads) {
+    if (size > 0x10000) {
+        size = 0x10000;
+    }
+    uint8_t *buf = malloc(size > 0 ? size : 1);
+    if (buf == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < size; i++) {
+        buf[i] = peek8(cpu, addr + i);
+    }
+    int n = d6502_disassemble_buffer(buf, size, addr, out, threads);
+    free(buf);
+    return n;
+}
+
+static const char digits[] = "0123456789ABCDEF";
+
+// hex with at least 'width' digits, like "%0*X"
+static char *hex(char *s, uint16_t v, int width) {
+    int n = v > 0xfff ? 4 : v > 0xff ? 3 : v > 0xf ? 2 : 1;
+    if (n < width) {
+        n = width;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        s[i] = digits[v & 0xf];
+        v >>= 4;
+    }
+    return s + n;
+}
+
+static char *str(char *s, const char *t) {
+    while (*t) {
+        *s++ = *t++;
+    }
+    return s;
+}
+
+// one line, at most 28 characters plus '\n'
+static char *format(char *s, const d6502_disasm_t *d) {
+    s = hex(s, d->addr, 4);
+    s = str(s, "  ");
+    for (int i = 0; i < 3; i++) {
+        if (i < d->len) {
+            s = hex(s, d->bytes[i], 2);
+        } else {
+            s = str(s, "  ");
+        }
+        *s++ = ' ';
+    }
+    *s++ = ' ';
+    if (!d->valid) {
+        return str(s, "INVALD ");
+    }
+    s = str(s, d->mnemonic);
+    *s++ = ' ';
+    uint8_t op8 = d->operand & 0xff;
+    // same operand syntax as d6502_disassemble()
+    switch (d->mode) {
+        case MODE_ACCUMULATOR: *s++ = 'A'; break;
+        case MODE_IMMEDIATE:   s = hex(str(s, "#$"), op8, 2); break;
+        case MODE_INDIRECT:    s = str(hex(str(s, "($"), d->operand, 4), ")"); break;
+        case MODE_INDIRECT_X:  s = str(hex(str(s, "($"), op8, 2), ",X)"); break;
+        case MODE_INDIRECT_Y:  s = str(hex(str(s, "($"), op8, 2), "),Y"); break;
+        case MODE_ZEROPAGE:    s = hex(str(s, "$"), op8, 2); break;
+        case MODE_ZEROPAGE_X:  s = str(hex(str(s, "$"), op8, 2), ",X"); break;
+        case MODE_ZEROPAGE_Y:  s = str(hex(str(s, "$"), op8, 2), ",Y"); break;
+        case MODE_ABSOLUTE_X:  s = str(hex(str(s, "$"), d->operand, 4), ",X"); break;
+        case MODE_ABSOLUTE_Y:  s = str(hex(str(s, "$"), d->operand, 4), ",Y"); break;
+        case MODE_ABSOLUTE:    s = hex(str(s, "$"), d->operand, 4); break;
+        case MODE_RELATIVE:    s = hex(str(s, "$"), d->target, 2); break;
+    }
+    return s;
+}
+
+int d6502_disassemble_text(const d6502_disasm_t *records, int count, char *buf, int size) {
+    char *s = buf;
+    int i;
+    // a line and the terminating 0 fit
+    for (i = 0; i < count && (s - buf) + 30 <= size; i++) {
+        s = format(s, &records[i]);
+        *s++ = '\n';
+    }
+    if (size > 0) {
+        *s = 0;
+    }
+    return i;
+}
@@ -0,0 +1,96 @@
+#include <stddef.h>
+#include "d6502.h"
+#include "d6502_private.h"
+
+// Event queue of a cpu, a binary min-heap in cpu->events ordered by the
+// cycle an event is due at. There are only a few events (vblank, mapper
+// irq, audio frame counter), so a fixed size heap in the cpu is enough.
+
+static void swap(d6502_event_t *a, d6502_event_t *b) {
+    d6502_event_t t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void sift_up(d6502_t *cpu, int i) {
+    while (i > 0 && cpu->events[(i - 1) / 2].when > cpu->events[i].when) {
+        swap(&cpu->events[(i - 1) / 2], &cpu->events[i]);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(d6502_t *cpu, int i) {
+    for (;;) {
+        int min = i;
+        int l = 2 * i + 1;
+        int r = l + 1;
+        if (l < cpu->event_count && cpu->events[l].when < cpu->events[min].when) {
+            min = l;
+        }
+        if (r < cpu->event_count && cpu->events[r].when < cpu->events[min].when) {
+            min = r;
+        }
+        if (min == i) {
+            return;
+        }
+        swap(&cpu->events[min], &cpu->events[i]);
+        i = min;
+    }
+}
+
+static void remove_event(d6502_t *cpu, int i) {
+    cpu->events[i] = cpu->events[--cpu->event_count];
+    if (i < cpu->event_count) {
+        sift_down(cpu, i);
+        sift_up(cpu, i);
+    }
+}
+
+void dispatch_events(d6502_t *cpu) {
+    while (cpu->event_count > 0 && cpu->events[0].when <= cpu->cycles) {
+        d6502_event_t e = cpu->events[0];
+        remove_event(cpu, 0);
+        e.callback(cpu, e.arg);
+    }
+}
+
+int d6502_schedule(d6502_t *cpu, uint64_t when, d6502_event_fn callback, void *arg) {
+    if (cpu->event_count == D6502_MAX_EVENTS) {
+        return -1;
+    }
+    int id = cpu->next_event_id;
+    cpu->next_event_id = (id + 1) & 0x7fffffff;
+    d6502_event_t *e = &cpu->events[cpu->event_count];
+    e->when = when;
+    e->callback = callback;
+    e->arg = arg;
+    e->id = id;
+    sift_up(cpu, cpu->event_count++);
+    return id;
+}
+
+static void raise_interrupt(d6502_t *cpu, void *arg) {
+    d6502_interrupt(cpu);
+}
+
+static void raise_nmi(d6502_t *cpu, void *arg) {
+    d6502_nmi(cpu);
+}
+
+int d6502_schedule_interrupt(d6502_t *cpu, uint64_t when) {
+    return d6502_schedule(cpu, when, raise_interrupt, NULL);
+}
+
+int d6502_schedule_nmi(d6502_t *cpu, uint64_t when) {
+    return d6502_schedule(cpu, when, raise_nmi, NULL);
+}
+
+bool d6502_cancel(d6502_t *cpu, int id) {
+    for (int i = 0; i < cpu->event_count; i++) {
+        if (cpu->events[i].id == id) {
+            remove_event(cpu, i);
+            return true;
+        }
+    }
+    return false;
+}
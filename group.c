@@ -0,0 +1,745 @@
+#include <limits.h>
+#include <string.h>
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+#include "cycle.h"
+
+// Lockstep execution of a group of cpus running the same program.
+//
+// While d6502_group_run() runs, the registers of all instances live in the
+// group, one array per register (structure of arrays). Every round the
+// instance with the fewest cycles done leads: all instances at the same pc
+// execute its instruction together. The instruction is decoded once, the
+// addressing and bus accesses are done per instance and the ALU and flag
+// work is done by kernels which loop over all instances and select the
+// result by the 'active' mask, so the compiler can vectorize them.
+//
+// Instructions without a kernel (BRK, RTI, JMP indirect, decimal mode
+// ADC/SBC, unofficial opcodes) and instances which cannot run in
+// lockstep (pending nmi/interrupt, trace, profile, per-cycle bus mode,
+// breakpoints, code on a page which is not immutable) run one by one
+// through step(). An instance with events runs in lockstep until its next
+// event is due, then one step() dispatches it.
+// How far an instance can run in lockstep is kept in 'until' and only
+// checked again after a step() or a bus callback.
+// Instances which take different branches simply run at different pcs
+// until they meet again.
+
+enum {
+    K_SCALAR = 0,
+    K_LDA, K_LDX, K_LDY,
+    K_STA, K_STX, K_STY,
+    K_ADC, K_SBC, K_AND, K_ORA, K_EOR, K_BIT,
+    K_CMP, K_CPX, K_CPY,
+    K_INX, K_INY, K_DEX, K_DEY,
+    K_TAX, K_TAY, K_TXA, K_TYA,
+    K_TSX, K_TXS,
+    K_CLC, K_SEC, K_CLV, K_CLI, K_SEI, K_CLD, K_SED, K_NOP,
+    K_BCC, K_BCS, K_BEQ, K_BNE, K_BMI, K_BPL, K_BVC, K_BVS,
+    K_JMP, K_JSR, K_RTS,
+    K_PHA, K_PLA, K_PHP, K_PLP,
+    // accumulator or memory
+    K_ASL, K_LSR, K_ROL, K_ROR,
+    K_INC, K_DEC
+};
+
+#define KERNEL_ADC (ENABLE_DECIMAL_MODE ? K_SCALAR : K_ADC)
+#define KERNEL_AND K_AND
+#define KERNEL_ASL K_ASL
+#define KERNEL_BCC K_BCC
+#define KERNEL_BCS K_BCS
+#define KERNEL_BEQ K_BEQ
+#define KERNEL_BIT K_BIT
+#define KERNEL_BMI K_BMI
+#define KERNEL_BNE K_BNE
+#define KERNEL_BPL K_BPL
+#define KERNEL_BRK K_SCALAR
+#define KERNEL_BVC K_BVC
+#define KERNEL_BVS K_BVS
+#define KERNEL_CLC K_CLC
+#define KERNEL_CLD K_CLD
+#define KERNEL_CLI K_CLI
+#define KERNEL_CLV K_CLV
+#define KERNEL_CMP K_CMP
+#define KERNEL_CPX K_CPX
+#define KERNEL_CPY K_CPY
+#define KERNEL_DCP K_SCALAR
+#define KERNEL_DEC K_DEC
+#define KERNEL_DEX K_DEX
+#define KERNEL_DEY K_DEY
+#define KERNEL_END K_SCALAR
+#define KERNEL_EOR K_EOR
+#define KERNEL_ILL K_SCALAR
+#define KERNEL_INC K_INC
+#define KERNEL_INX K_INX
+#define KERNEL_INY K_INY
+#define KERNEL_JMP K_JMP
+#define KERNEL_JSR K_JSR
+#define KERNEL_LAX K_SCALAR
+#define KERNEL_LDA K_LDA
+#define KERNEL_LDX K_LDX
+#define KERNEL_LDY K_LDY
+#define KERNEL_LSR K_LSR
+#define KERNEL_NOP K_NOP
+#define KERNEL_ORA K_ORA
+#define KERNEL_PHA K_PHA
+#define KERNEL_PHP K_PHP
+#define KERNEL_PLA K_PLA
+#define KERNEL_PLP K_PLP
+#define KERNEL_ROL K_ROL
+#define KERNEL_ROR K_ROR
+#define KERNEL_RTI K_SCALAR
+#define KERNEL_RTS K_RTS
+#define KERNEL_SAX K_SCALAR
+#define KERNEL_SBC (ENABLE_DECIMAL_MODE ? K_SCALAR : K_SBC)
+#define KERNEL_SEC K_SEC
+#define KERNEL_SED K_SED
+#define KERNEL_SEI K_SEI
+#define KERNEL_STA K_STA
+#define KERNEL_STX K_STX
+#define KERNEL_STY K_STY
+#define KERNEL_TAX K_TAX
+#define KERNEL_TAY K_TAY
+#define KERNEL_TSX K_TSX
+#define KERNEL_TXA K_TXA
+#define KERNEL_TXS K_TXS
+#define KERNEL_TYA K_TYA
+#define KERNEL_iSBC K_SCALAR
+
+// kernel of every opcode, JMP indirect and undefined opcodes run scalar
+static const uint8_t kernels[256] = {
+#define INSTRUCTION(opc, op, mnemonic, am, l, cyc) \
+    [opc] = (KERNEL_##op == K_JMP && MODE_##am == MODE_INDIRECT) ? K_SCALAR : KERNEL_##op,
+#include "instruction_table.def"
+#undef INSTRUCTION
+};
+
+// The kernels loop over all lanes, lanes without an instance are never
+// active. The constant trip count lets the compiler vectorize them at -O2.
+#define LANES D6502_GROUP_MAX
+
+// result of a kernel for the instances in the active mask, a blend
+// without a branch, so both sides are always evaluated
+#define SEL(i, new, old) ((uint8_t)(((new) & -g->active[i]) | ((old) & (g->active[i] - 1))))
+
+// true if the instance may run in lockstep
+static bool ready(const d6502_t *cpu) {
+    return !cpu->nmi && !cpu->interrupt && !cpu->halt
+        && !cpu->trace && !cpu->profile && cpu->bus_mode == D6502_BUS_INSTRUCTION
+        && !(cpu->watch && cpu->watch->breakpoints > 0);
+}
+
+// sets how far instance i may run in lockstep: 0 if it is not ready, else
+// up to the cycle its next event is due at
+static void check(d6502_group_t *g, int i) {
+    const d6502_t *cpu = g->cpu[i];
+    int64_t until = INT_MAX;
+    if (!ready(cpu)) {
+        until = 0;
+    } else if (cpu->event_count > 0) {
+        // the event heap keeps the next event first
+        until = cpu->events[0].when > g->cycles[i] ? cpu->events[0].when - g->cycles[i] : 0;
+    }
+    g->until[i] = until < INT_MAX ? until : INT_MAX;
+}
+
+static void load_lane(d6502_group_t *g, int i) {
+    const d6502_t *cpu = g->cpu[i];
+    uint8_t st = get_status(cpu);
+    g->a[i] = cpu->a;
+    g->x[i] = cpu->x;
+    g->y[i] = cpu->y;
+    g->sp[i] = cpu->sp;
+    g->pc[i] = cpu->pc;
+    g->p[i] = st & ~(FLAG_N | FLAG_Z | FLAG_C | FLAG_V);
+    g->n[i] = st;
+    g->z[i] = ~st & FLAG_Z;
+    g->c[i] = st & FLAG_C;
+    g->v[i] = st << 1;
+    // counters as of the start of the run, see store_lane()
+    g->cycles[i] = cpu->cycles - g->done[i];
+    g->instructions[i] = cpu->instructions - g->executed[i];
+    check(g, i);
+}
+
+static void store_lane(d6502_group_t *g, int i) {
+    d6502_t *cpu = g->cpu[i];
+    cpu->a = g->a[i];
+    cpu->x = g->x[i];
+    cpu->y = g->y[i];
+    cpu->sp = g->sp[i];
+    cpu->pc = g->pc[i];
+    set_status(cpu, g->p[i]
+        | (g->n[i] & FLAG_N)
+        | (g->z[i] ? 0 : FLAG_Z)
+        | (g->c[i] ? FLAG_C : 0)
+        | ((g->v[i] & 0x80) ? FLAG_V : 0));
+    cpu->cycles = g->cycles[i] + g->done[i];
+    cpu->instructions = g->instructions[i] + g->executed[i];
+}
+
+// runs one instruction of instance i on its own d6502_t
+static void scalar_step(d6502_group_t *g, int i, int cycles) {
+    d6502_t *cpu = g->cpu[i];
+    store_lane(g, i);
+    dispatch_events(cpu);
+    if (cpu->halt || breakpoint(cpu)) {
+        g->done[i] = cycles;
+    } else {
+        if (cpu->bus_mode == D6502_BUS_CYCLE) {
+            do {
+                cycle_step(cpu);
+                g->done[i]++;
+            } while (cpu->cycle_pos);
+        } else {
+            step(cpu);
+            g->done[i] += cpu->current_cycle;
+        }
+        cpu->current_cycle = 0;
+        g->scalar++;
+    }
+    load_lane(g, i);
+}
+
+// Bus accesses of instance i. A bus callback may raise an interrupt, halt
+// the cpu or schedule an event, so the instance is checked again after it.
+static uint8_t lane_read(d6502_group_t *g, int i, uint16_t addr) {
+    d6502_t *cpu = g->cpu[i];
+    const uint8_t *page = cpu->read_page[addr >> 8];
+    if (page) {
+        return page[addr & 0xff];
+    }
+    uint8_t dat = read8(cpu, addr);
+    check(g, i);
+    return dat;
+}
+
+static void lane_write(d6502_group_t *g, int i, uint16_t addr, uint8_t dat) {
+    d6502_t *cpu = g->cpu[i];
+    uint8_t *page = cpu->write_page[addr >> 8];
+    if (page) {
+        cpu->dirty[addr >> 8] = true;
+        page[addr & 0xff] = dat;
+    } else {
+        write8(cpu, addr, dat);
+        check(g, i);
+    }
+}
+
+// effective address of every active instance, page crossings in 'extra'
+static void address(d6502_group_t *g, const instruction_t *instruction, uint16_t operand) {
+    int n = LANES;
+    memset(g->extra, 0, n);
+    switch (instruction->mode) {
+        case MODE_ZEROPAGE:
+        case MODE_ABSOLUTE:
+            for (int i = 0; i < n; i++) {
+                g->addr[i] = operand;
+            }
+            break;
+        case MODE_ZEROPAGE_X:
+            for (int i = 0; i < n; i++) {
+                g->addr[i] = (operand + g->x[i]) & 0xff;
+            }
+            break;
+        case MODE_ZEROPAGE_Y:
+            for (int i = 0; i < n; i++) {
+                g->addr[i] = (operand + g->y[i]) & 0xff;
+            }
+            break;
+        case MODE_ABSOLUTE_X:
+            for (int i = 0; i < n; i++) {
+                g->addr[i] = operand + g->x[i];
+                g->extra[i] = PAGE_WRAP(operand, g->addr[i]);
+            }
+            break;
+        case MODE_ABSOLUTE_Y:
+            for (int i = 0; i < n; i++) {
+                g->addr[i] = operand + g->y[i];
+                g->extra[i] = PAGE_WRAP(operand, g->addr[i]);
+            }
+            break;
+        case MODE_INDIRECT_X:
+            for (int i = 0; i < n; i++) {
+                if (g->active[i]) {
+                    uint8_t zp = operand + g->x[i];
+                    g->addr[i] = lane_read(g, i, zp) | lane_read(g, i, (uint8_t)(zp + 1)) << 8;
+                }
+            }
+            break;
+        case MODE_INDIRECT_Y:
+            for (int i = 0; i < n; i++) {
+                if (g->active[i]) {
+                    uint8_t zp = operand;
+                    uint16_t base = lane_read(g, i, zp) | lane_read(g, i, (uint8_t)(zp + 1)) << 8;
+                    g->addr[i] = base + g->y[i];
+                    g->extra[i] = PAGE_WRAP(base, g->addr[i]);
+                }
+            }
+            break;
+        case MODE_IMMEDIATE:
+            for (int i = 0; i < n; i++) {
+                g->m[i] = operand;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// reads the operand of every active instance
+static void load(d6502_group_t *g) {
+    for (int i = 0; i < g->count; i++) {
+        if (g->active[i]) {
+            g->m[i] = lane_read(g, i, g->addr[i]);
+        }
+    }
+}
+
+// writes 'reg' of every active instance to its effective address
+static void write_back(d6502_group_t *g, const uint8_t *reg) {
+    for (int i = 0; i < g->count; i++) {
+        if (g->active[i]) {
+            lane_write(g, i, g->addr[i], reg[i]);
+        }
+    }
+}
+
+static void store(d6502_group_t *g, const uint8_t *reg) {
+    write_back(g, reg);
+    // like STA, stores never take an extra cycle on page crossing
+    memset(g->extra, 0, LANES);
+}
+
+static void push(d6502_group_t *g, const uint8_t *reg) {
+    for (int i = 0; i < g->count; i++) {
+        if (g->active[i]) {
+            lane_write(g, i, 0x100 + g->sp[i], reg[i]);
+            g->sp[i]--;
+        }
+    }
+}
+
+// pulls a byte into 'm'
+static void pull(d6502_group_t *g) {
+    for (int i = 0; i < g->count; i++) {
+        if (g->active[i]) {
+            g->sp[i]++;
+            g->m[i] = lane_read(g, i, 0x100 + g->sp[i]);
+        }
+    }
+}
+
+// sets the pc of the active instances, lockstep() adds the length
+static void jump(d6502_group_t *g, uint16_t target) {
+    for (int i = 0; i < LANES; i++) {
+        g->pc[i] = g->active[i] ? target : g->pc[i];
+    }
+}
+
+// sets or clears the I, D, B or R bits in 'mask'
+static void flag(d6502_group_t *g, uint8_t mask, bool set) {
+    for (int i = 0; i < LANES; i++) {
+        g->p[i] = SEL(i, set ? g->p[i] | mask : g->p[i] & ~mask, g->p[i]);
+    }
+}
+
+// sets N and Z of the active instances from 'r' and copies 'r' into the
+// register 'dst', the arrays are distinct (restrict lets the loop vectorize)
+static void result(d6502_group_t *g, uint8_t *restrict dst, const uint8_t *restrict r) {
+    for (int i = 0; i < LANES; i++) {
+        g->n[i] = SEL(i, r[i], g->n[i]);
+        g->z[i] = SEL(i, r[i], g->z[i]);
+        dst[i] = SEL(i, r[i], dst[i]);
+    }
+}
+
+static void compare(d6502_group_t *g, const uint8_t *restrict reg) {
+    for (int i = 0; i < LANES; i++) {
+        uint16_t t = reg[i] - g->m[i];
+        g->c[i] = SEL(i, t < 0x100, g->c[i]);
+        g->n[i] = SEL(i, (uint8_t)t, g->n[i]);
+        g->z[i] = SEL(i, (uint8_t)t, g->z[i]);
+    }
+}
+
+// 'taken' holds the branch condition per instance
+static void branch(d6502_group_t *g, const uint8_t *restrict taken, uint16_t pc, uint16_t operand) {
+    uint16_t target = pc + (int8_t)operand;
+    uint8_t extra = 1 + PAGE_WRAP((uint16_t)(pc + 2), target);
+    for (int i = 0; i < LANES; i++) {
+        uint8_t t = g->active[i] & taken[i];
+        g->pc[i] = t ? target : g->pc[i];
+        g->extra[i] = t ? extra : g->extra[i];
+    }
+}
+
+// executes the instruction at 'pc' for all active instances
+static void lockstep(d6502_group_t *g, const instruction_t *instruction, int kernel, uint16_t pc, uint16_t operand) {
+    int n = LANES;
+    uint8_t *r = g->r;
+    address(g, instruction, operand);
+    switch (kernel) {
+        case K_LDA: case K_LDX: case K_LDY:
+        case K_ADC: case K_SBC: case K_AND: case K_ORA: case K_EOR: case K_BIT:
+        case K_CMP: case K_CPX: case K_CPY:
+            if (instruction->mode != MODE_IMMEDIATE) {
+                load(g);
+            }
+            break;
+        case K_ASL: case K_LSR: case K_ROL: case K_ROR:
+            if (instruction->mode != MODE_ACCUMULATOR) {
+                load(g);
+            } else {
+                memcpy(g->m, g->a, LANES);
+            }
+            break;
+        case K_INC: case K_DEC:
+            load(g);
+            break;
+    }
+    switch (kernel) {
+        case K_LDA: result(g, g->a, g->m); break;
+        case K_LDX: result(g, g->x, g->m); break;
+        case K_LDY: result(g, g->y, g->m); break;
+        case K_STA: store(g, g->a); break;
+        case K_STX: store(g, g->x); break;
+        case K_STY: store(g, g->y); break;
+        case K_ADC:
+            for (int i = 0; i < n; i++) {
+                unsigned int t = g->a[i] + g->m[i] + g->c[i];
+                g->v[i] = SEL(i, ~(g->a[i] ^ g->m[i]) & (g->a[i] ^ t), g->v[i]);
+                g->c[i] = SEL(i, t > 0xff, g->c[i]);
+                r[i] = t;
+            }
+            result(g, g->a, r);
+            break;
+        case K_SBC:
+            for (int i = 0; i < n; i++) {
+                unsigned int t = g->a[i] - g->m[i] - !g->c[i];
+                g->v[i] = SEL(i, (g->a[i] ^ t) & (g->a[i] ^ g->m[i]), g->v[i]);
+                g->c[i] = SEL(i, t < 0x100, g->c[i]);
+                r[i] = t;
+            }
+            result(g, g->a, r);
+            break;
+        case K_AND:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->a[i] & g->m[i];
+            }
+            result(g, g->a, r);
+            break;
+        case K_ORA:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->a[i] | g->m[i];
+            }
+            result(g, g->a, r);
+            break;
+        case K_EOR:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->a[i] ^ g->m[i];
+            }
+            result(g, g->a, r);
+            break;
+        case K_BIT:
+            for (int i = 0; i < n; i++) {
+                g->n[i] = SEL(i, g->m[i], g->n[i]);
+                g->v[i] = SEL(i, (uint8_t)(g->m[i] << 1), g->v[i]);
+                g->z[i] = SEL(i, g->a[i] & g->m[i], g->z[i]);
+            }
+            break;
+        case K_CMP: compare(g, g->a); break;
+        case K_CPX: compare(g, g->x); break;
+        case K_CPY: compare(g, g->y); break;
+        case K_INX:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->x[i] + 1;
+            }
+            result(g, g->x, r);
+            break;
+        case K_INY:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->y[i] + 1;
+            }
+            result(g, g->y, r);
+            break;
+        case K_DEX:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->x[i] - 1;
+            }
+            result(g, g->x, r);
+            break;
+        case K_DEY:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->y[i] - 1;
+            }
+            result(g, g->y, r);
+            break;
+        case K_TAX: result(g, g->x, g->a); break;
+        case K_TAY: result(g, g->y, g->a); break;
+        case K_TXA: result(g, g->a, g->x); break;
+        case K_TYA: result(g, g->a, g->y); break;
+        case K_CLC:
+            for (int i = 0; i < n; i++) {
+                g->c[i] = SEL(i, 0, g->c[i]);
+            }
+            break;
+        case K_SEC:
+            for (int i = 0; i < n; i++) {
+                g->c[i] = SEL(i, 1, g->c[i]);
+            }
+            break;
+        case K_CLV:
+            for (int i = 0; i < n; i++) {
+                g->v[i] = SEL(i, 0, g->v[i]);
+            }
+            break;
+        case K_CLI: flag(g, FLAG_I, false); break;
+        case K_SEI: flag(g, FLAG_I, true); break;
+        case K_CLD: flag(g, FLAG_D, false); break;
+        case K_SED: flag(g, FLAG_D, true); break;
+        case K_TSX: result(g, g->x, g->sp); break;
+        case K_TXS:
+            for (int i = 0; i < n; i++) {
+                g->sp[i] = SEL(i, g->x[i], g->sp[i]);
+            }
+            break;
+        case K_NOP:
+            break;
+        case K_JMP:
+            jump(g, operand - instruction->len);
+            break;
+        case K_JSR:
+            // return address - 1, high byte first
+            memset(r, (uint16_t)(pc + 2) >> 8, LANES);
+            push(g, r);
+            memset(r, (uint8_t)(pc + 2), LANES);
+            push(g, r);
+            jump(g, operand - instruction->len);
+            break;
+        case K_RTS:
+            pull(g);
+            memcpy(r, g->m, LANES);
+            pull(g);
+            for (int i = 0; i < n; i++) {
+                uint16_t ret = r[i] | g->m[i] << 8;
+                g->pc[i] = g->active[i] ? ret + 1 - instruction->len : g->pc[i];
+            }
+            break;
+        case K_PHA: push(g, g->a); break;
+        case K_PLA:
+            pull(g);
+            result(g, g->a, g->m);
+            break;
+        case K_PHP:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->p[i] | FLAG_B
+                    | (g->n[i] & FLAG_N)
+                    | (g->z[i] ? 0 : FLAG_Z)
+                    | (g->c[i] ? FLAG_C : 0)
+                    | ((g->v[i] & 0x80) ? FLAG_V : 0);
+            }
+            push(g, r);
+            break;
+        case K_PLP:
+            pull(g);
+            for (int i = 0; i < n; i++) {
+                uint8_t st = (g->m[i] & ~FLAG_B) | FLAG_R;
+                g->p[i] = SEL(i, st & ~(FLAG_N | FLAG_Z | FLAG_C | FLAG_V), g->p[i]);
+                g->n[i] = SEL(i, st, g->n[i]);
+                g->z[i] = SEL(i, ~st & FLAG_Z, g->z[i]);
+                g->c[i] = SEL(i, st & FLAG_C, g->c[i]);
+                g->v[i] = SEL(i, st << 1, g->v[i]);
+            }
+            break;
+        case K_ASL:
+            for (int i = 0; i < n; i++) {
+                g->c[i] = SEL(i, g->m[i] >> 7, g->c[i]);
+                r[i] = g->m[i] << 1;
+            }
+            break;
+        case K_LSR:
+            for (int i = 0; i < n; i++) {
+                g->c[i] = SEL(i, g->m[i] & 1, g->c[i]);
+                r[i] = g->m[i] >> 1;
+            }
+            break;
+        case K_ROL:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->m[i] << 1 | (g->c[i] != 0);
+                g->c[i] = SEL(i, g->m[i] >> 7, g->c[i]);
+            }
+            break;
+        case K_ROR:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->m[i] >> 1 | (g->c[i] ? 0x80 : 0);
+                g->c[i] = SEL(i, g->m[i] & 1, g->c[i]);
+            }
+            break;
+        case K_INC:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->m[i] + 1;
+            }
+            break;
+        case K_DEC:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->m[i] - 1;
+            }
+            break;
+        case K_BCC:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->c[i] == 0;
+            }
+            branch(g, r, pc, operand);
+            break;
+        case K_BCS:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->c[i] != 0;
+            }
+            branch(g, r, pc, operand);
+            break;
+        case K_BEQ:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->z[i] == 0;
+            }
+            branch(g, r, pc, operand);
+            break;
+        case K_BNE:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->z[i] != 0;
+            }
+            branch(g, r, pc, operand);
+            break;
+        case K_BMI:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->n[i] >> 7;
+            }
+            branch(g, r, pc, operand);
+            break;
+        case K_BPL:
+            for (int i = 0; i < n; i++) {
+                r[i] = !(g->n[i] & 0x80);
+            }
+            branch(g, r, pc, operand);
+            break;
+        case K_BVC:
+            for (int i = 0; i < n; i++) {
+                r[i] = !(g->v[i] & 0x80);
+            }
+            branch(g, r, pc, operand);
+            break;
+        case K_BVS:
+            for (int i = 0; i < n; i++) {
+                r[i] = g->v[i] >> 7;
+            }
+            branch(g, r, pc, operand);
+            break;
+    }
+    switch (kernel) {
+        case K_ASL: case K_LSR: case K_ROL: case K_ROR:
+        case K_INC: case K_DEC:
+            // read-modify-write, written once like in operations.c
+            if (instruction->mode == MODE_ACCUMULATOR) {
+                result(g, g->a, r);
+            } else {
+                result(g, g->m, r);
+                write_back(g, g->m);
+                // like STA, no extra cycle on page crossing
+                memset(g->extra, 0, LANES);
+            }
+            break;
+    }
+    // active is 0 or 1
+    int len = instruction->len;
+    int cycles = instruction->cycles;
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        g->pc[i] += g->active[i] * len;
+        g->done[i] += g->active[i] * (cycles + g->extra[i]);
+        g->executed[i] += g->active[i];
+        count += g->active[i];
+    }
+    g->lockstep += count;
+}
+
+void d6502_group_init(d6502_group_t *g) {
+    memset(g, 0, sizeof(*g));
+}
+
+bool d6502_group_add(d6502_group_t *g, d6502_t *cpu) {
+    if (g->count == D6502_GROUP_MAX) {
+        return false;
+    }
+    g->cpu[g->count++] = cpu;
+    return true;
+}
+
+// the instance furthest behind
+static int behind(const d6502_group_t *g) {
+    int min = INT_MAX;
+    for (int i = 0; i < LANES; i++) {
+        min = g->done[i] < min ? g->done[i] : min;
+    }
+    int lead = 0;
+    while (g->done[lead] != min) {
+        lead++;
+    }
+    return lead;
+}
+
+void d6502_group_run(d6502_group_t *g, int cycles) {
+    int n = g->count;
+    for (int i = 0; i < LANES; i++) {
+        // lanes without an instance never lead
+        g->done[i] = INT_MAX;
+        g->executed[i] = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        // finishes an instruction started by d6502_tick()
+        g->done[i] = g->cpu[i]->halt ? cycles : d6502_run(g->cpu[i], 0);
+        load_lane(g, i);
+    }
+    for (;;) {
+        int lead = behind(g);
+        if (n == 0 || g->done[lead] >= cycles) {
+            break;
+        }
+        if (g->cpu[lead]->halt) {
+            // halted by a bus callback
+            store_lane(g, lead);
+            g->done[lead] = cycles;
+            load_lane(g, lead);
+            continue;
+        }
+        // immutable pages hold the same code in every instance
+        d6502_t *cpu = g->cpu[lead];
+        uint16_t pc = g->pc[lead];
+        if (g->done[lead] >= g->until[lead] || !(cpu->page_flags[pc >> 8] & D6502_PAGE_IMMUTABLE)
+            || !(cpu->page_flags[(uint16_t)(pc + 2) >> 8] & D6502_PAGE_IMMUTABLE)) {
+            scalar_step(g, lead, cycles);
+            continue;
+        }
+        uint8_t opcode = read8(cpu, pc);
+        int kernel = kernels[opcode];
+        if (kernel == K_SCALAR) {
+            scalar_step(g, lead, cycles);
+            continue;
+        }
+        const instruction_t *instruction = get_instruction(opcode);
+        uint16_t operand = 0;
+        if (instruction->len > 1) {
+            operand = read8(cpu, pc + 1);
+        }
+        if (instruction->len > 2) {
+            operand |= read8(cpu, pc + 2) << 8;
+        }
+        for (int i = 0; i < LANES; i++) {
+            g->active[i] = (g->pc[i] == pc) & (g->done[i] < cycles) & (g->done[i] < g->until[i]);
+        }
+        lockstep(g, instruction, kernel, pc, operand);
+    }
+    for (int i = 0; i < n; i++) {
+        store_lane(g, i);
+    }
+}
@@ -0,0 +1,155 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "d6502.h"
+
+// iNES and NES 2.0 ROM files, see https://www.nesdev.org/wiki/NES_2.0
+//
+// The file is mapped read-only and all banks point into the mapping, so
+// opening a ROM reads nothing but the header; the banks are paged in by
+// the host when the cpu first touches them.
+
+#define HEADER_SIZE 16
+#define TRAINER_SIZE 512
+
+// NES 2.0 ROM size: 12 bit count of 'unit' bytes, or, with the upper
+// nibble 0xF, 2^E * (M*2+1) bytes from the low byte EEEEEEMM
+static uint64_t rom_size(uint8_t lsb, uint8_t msb, uint32_t unit) {
+    if (msb == 0xf) {
+        int exponent = lsb >> 2;
+        return exponent < 62 ? ((uint64_t)1 << exponent) * ((lsb & 3) * 2 + 1) : UINT64_MAX;
+    }
+    return ((uint64_t)msb << 8 | lsb) * unit;
+}
+
+// NES 2.0 RAM size: 64 << shift bytes, 0 for none
+static uint32_t ram_size(uint8_t shift) {
+    return shift ? 64u << shift : 0;
+}
+
+bool d6502_rom_parse(d6502_rom_t *rom, const uint8_t *data, size_t size) {
+    memset(rom, 0, sizeof(*rom));
+    if (size < HEADER_SIZE || memcmp(data, "NES\x1a", 4) != 0) {
+        return false;
+    }
+    const uint8_t *h = data;
+    rom->data = data;
+    rom->size = size;
+    rom->nes2 = (h[7] & 0x0c) == 0x08;
+    rom->mirroring = h[6] & 0x01 ? D6502_MIRROR_VERTICAL : D6502_MIRROR_HORIZONTAL;
+    if (h[6] & 0x08) {
+        rom->mirroring = D6502_MIRROR_FOUR_SCREEN;
+    }
+    rom->battery = (h[6] & 0x02) != 0;
+    uint64_t prg_size;
+    uint64_t chr_size;
+    if (rom->nes2) {
+        rom->mapper = (h[6] >> 4) | (h[7] & 0xf0) | ((h[8] & 0x0f) << 8);
+        rom->submapper = h[8] >> 4;
+        rom->console = h[7] & 0x03;
+        rom->timing = h[12] & 0x03;
+        prg_size = rom_size(h[4], h[9] & 0x0f, 0x4000);
+        chr_size = rom_size(h[5], h[9] >> 4, 0x2000);
+        rom->prg_ram_size = ram_size(h[10] & 0x0f);
+        rom->prg_nvram_size = ram_size(h[10] >> 4);
+        rom->chr_ram_size = ram_size(h[11] & 0x0f);
+        rom->chr_nvram_size = ram_size(h[11] >> 4);
+    } else {
+        rom->mapper = h[6] >> 4;
+        // some rippers put their name into bytes 7..15, byte 7 is not a
+        // mapper nibble then
+        if (h[12] == 0 && h[13] == 0 && h[14] == 0 && h[15] == 0) {
+            rom->mapper |= h[7] & 0xf0;
+            rom->console = h[7] & 0x03;
+        }
+        rom->timing = h[9] & 0x01 ? D6502_TIMING_PAL : D6502_TIMING_NTSC;
+        prg_size = (uint64_t)h[4] * 0x4000;
+        chr_size = (uint64_t)h[5] * 0x2000;
+        // 0 means 8KB for compatibility
+        rom->prg_ram_size = (h[8] ? h[8] : 1) * 0x2000;
+        rom->chr_ram_size = chr_size ? 0 : 0x2000;
+    }
+
+    size_t offset = HEADER_SIZE;
+    if (h[6] & 0x04) {
+        if (size - offset < TRAINER_SIZE) {
+            return false;
+        }
+        rom->trainer = data + offset;
+        offset += TRAINER_SIZE;
+    }
+    if (prg_size == 0 || prg_size > size - offset) {
+        return false;
+    }
+    rom->prg = data + offset;
+    rom->prg_size = prg_size;
+    offset += prg_size;
+    if (chr_size > size - offset) {
+        return false;
+    }
+    rom->chr = chr_size ? data + offset : NULL;
+    rom->chr_size = chr_size;
+    offset += chr_size;
+    // PlayChoice or NES 2.0 miscellaneous ROMs, or a title
+    rom->misc = size > offset ? data + offset : NULL;
+    rom->misc_size = size - offset;
+    return true;
+}
+
+bool d6502_rom_open(d6502_rom_t *rom, const char *fn) {
+    memset(rom, 0, sizeof(*rom));
+    int fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= HEADER_SIZE) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // the mapping stays valid without the file descriptor
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    if (!d6502_rom_parse(rom, data, st.st_size)) {
+        munmap(data, st.st_size);
+        return false;
+    }
+    rom->mapped = true;
+    return true;
+}
+
+void d6502_rom_close(d6502_rom_t *rom) {
+    if (rom->mapped) {
+        munmap((void *)rom->data, rom->size);
+    }
+    memset(rom, 0, sizeof(*rom));
+}
+
+const uint8_t *d6502_rom_prg_bank(const d6502_rom_t *rom, int bank, uint32_t bank_size) {
+    if (bank < 0 || bank_size == 0 || (uint64_t)(bank + 1) * bank_size > rom->prg_size) {
+        return NULL;
+    }
+    return rom->prg + (uint64_t)bank * bank_size;
+}
+
+const uint8_t *d6502_rom_chr_bank(const d6502_rom_t *rom, int bank, uint32_t bank_size) {
+    if (bank < 0 || bank_size == 0 || (uint64_t)(bank + 1) * bank_size > rom->chr_size) {
+        return NULL;
+    }
+    return rom->chr + (uint64_t)bank * bank_size;
+}
+
+bool d6502_rom_map_prg(d6502_t *cpu, const d6502_rom_t *rom, uint8_t first, int bank, uint32_t bank_size) {
+    const uint8_t *mem = d6502_rom_prg_bank(rom, bank, bank_size);
+    if (mem == NULL || bank_size % 0x100 != 0) {
+        return false;
+    }
+    int pages = bank_size >> 8;
+    d6502_map_rom(cpu, first, pages, mem);
+    d6502_set_immutable(cpu, first, pages, true);
+    return true;
+}
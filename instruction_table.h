@@ -3,8 +3,9 @@
 
 #include "d6502.h"
 
-void initialize_instructions_sorted(void);
-
 const instruction_t *get_instruction(uint8_t opcode);
 
+// returns "" for undefined opcodes
+const char *get_mnemonic(uint8_t opcode);
+
 #endif
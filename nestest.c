@@ -0,0 +1,179 @@
+#include "d6502.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Headless nestest runner. Runs test/nestest.nes in automation mode
+// (starting at $C000) and compares PC, A, X, Y, P, SP and the cycle count
+// before every instruction with the reference log. Stops at the first
+// difference and exits with 1, exits with 0 when all compared lines match.
+//
+// usage: nestest [nestest.nes] [nestest.log] [lines] [trace.bin]
+//
+// With 'trace.bin' the executed instructions are traced and saved there
+// when the run ends, see tracedump.
+//
+// By default the first 5851 lines are compared, these cover all official
+// opcodes and the unofficial NOPs. The unofficial opcodes which follow,
+// starting with DCP on line 5851, are not emulated correctly yet.
+
+#define DEFAULT_LINES 5851
+#define TRACE_SIZE (1 << 16)
+
+typedef struct {
+    uint16_t pc;
+    uint8_t a, x, y, p, sp;
+    long cyc;
+} state_t;
+
+static uint8_t memory[0x10000];
+static d6502_trace_t trace;
+static d6502_trace_record_t records[TRACE_SIZE];
+
+static void writebus(void *userdata, uint16_t addr, uint8_t dat) {
+    ((uint8_t *)userdata)[addr] = dat;
+}
+
+static uint8_t readbus(void *userdata, uint16_t addr) {
+    return ((uint8_t *)userdata)[addr];
+}
+
+static char *load_file(const char *fn, long *size) {
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(*size + 1);
+    if (fread(buf, 1, *size, f) != (size_t)*size) {
+        free(buf);
+        buf = NULL;
+    } else {
+        buf[*size] = 0;
+    }
+    fclose(f);
+    return buf;
+}
+
+// splits the log into lines and parses the cpu state of each line,
+// returns the number of lines
+static int parse_log(char *log, char ***lines, state_t **states) {
+    int n = 0;
+    for (char *s = log; *s; s++) {
+        n += *s == '\n';
+    }
+    *lines = malloc((n + 1) * sizeof(char *));
+    *states = malloc((n + 1) * sizeof(state_t));
+    n = 0;
+    for (char *s = strtok(log, "\r\n"); s; s = strtok(NULL, "\r\n")) {
+        unsigned pc, a, x, y, p, sp;
+        state_t *st = &(*states)[n];
+        char *regs = strstr(s, "A:");
+        char *cyc = strstr(s, "CYC:");
+        if (sscanf(s, "%4X", &pc) != 1 || regs == NULL || cyc == NULL
+            || sscanf(regs, "A:%2X X:%2X Y:%2X P:%2X SP:%2X", &a, &x, &y, &p, &sp) != 5
+            || sscanf(cyc, "CYC:%ld", &st->cyc) != 1) {
+            fprintf(stderr, "cannot parse log line %d: %s\n", n + 1, s);
+            exit(2);
+        }
+        st->pc = pc;
+        st->a = a;
+        st->x = x;
+        st->y = y;
+        st->p = p;
+        st->sp = sp;
+        (*lines)[n++] = s;
+    }
+    return n;
+}
+
+static bool same_state(const state_t *a, const state_t *b) {
+    return a->pc == b->pc && a->a == b->a && a->x == b->x && a->y == b->y
+        && a->p == b->p && a->sp == b->sp && a->cyc == b->cyc;
+}
+
+static void print_state(const char *prefix, const state_t *st) {
+    printf("%s %04X  A:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%ld\n", prefix,
+        st->pc, st->a, st->x, st->y, st->p, st->sp, st->cyc);
+}
+
+int main(int argc, char *argv[]) {
+    const char *rom_fn = argc > 1 ? argv[1] : "test/nestest.nes";
+    const char *log_fn = argc > 2 ? argv[2] : "test/nestest.log";
+    int count = argc > 3 ? atoi(argv[3]) : DEFAULT_LINES;
+    const char *trace_fn = argc > 4 ? argv[4] : NULL;
+
+    d6502_rom_t rom;
+    const uint8_t *prg = d6502_rom_open(&rom, rom_fn) ? d6502_rom_prg_bank(&rom, 0, 0x4000) : NULL;
+    if (prg) {
+        // copied, the reset vector is patched below
+        memcpy(&memory[0xc000], prg, 0x4000);
+    }
+    d6502_rom_close(&rom);
+    if (prg == NULL) {
+        fprintf(stderr, "cannot load %s\n", rom_fn);
+        return 2;
+    }
+    memory[RESET_ADDR] = 0x00;
+    memory[RESET_ADDR + 1] = 0xc0;
+
+    long size;
+    char *log = load_file(log_fn, &size);
+    if (log == NULL) {
+        fprintf(stderr, "cannot load %s\n", log_fn);
+        return 2;
+    }
+    char **lines;
+    state_t *expected;
+    int n = parse_log(log, &lines, &expected);
+    if (count <= 0 || count > n) {
+        count = n;
+    }
+
+    d6502_t cpu;
+    d6502_init(&cpu);
+    cpu.read = readbus;
+    cpu.write = writebus;
+    cpu.userdata = memory;
+    d6502_map_ram(&cpu, 0, 256, memory);
+    d6502_reset(&cpu);
+    if (trace_fn) {
+        d6502_trace_attach(&cpu, &trace, records, TRACE_SIZE);
+    }
+
+    state_t got = { 0 };
+    int i;
+    for (i = 0; i < count; i++) {
+        got.pc = cpu.pc;
+        got.a = cpu.a;
+        got.x = cpu.x;
+        got.y = cpu.y;
+        got.p = cpu.st;
+        got.sp = cpu.sp;
+        got.cyc = d6502_cycles(&cpu);
+        if (!same_state(&got, &expected[i]) || cpu.halt) {
+            printf("FAIL at line %d of %s\n", i + 1, log_fn);
+            if (i > 0) {
+                printf("  previous: %s\n", lines[i - 1]);
+            }
+            printf("  expected: %s\n", lines[i]);
+            print_state("  log:", &expected[i]);
+            print_state("  cpu:", &got);
+            if (cpu.halt) {
+                printf("  cpu halted\n");
+            }
+            break;
+        }
+        d6502_run(&cpu, 1);
+    }
+    if (trace_fn && !d6502_trace_save(&trace, trace_fn)) {
+        fprintf(stderr, "cannot write %s\n", trace_fn);
+    }
+    if (i < count) {
+        return 1;
+    }
+    printf("PASS %d lines\n", count);
+    return 0;
+}
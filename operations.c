@@ -1,18 +1,20 @@
 #include "d6502.h"
 #include "d6502_private.h"
-#include "addressing.h"
 #include <stdio.h>
 
 // Endianess: low byte on lower address
 
-#define IS_ACC_ADDRESSING(cpu) (cpu->instruction->addressing == Accumulator)
+#define IS_ACC_ADDRESSING(cpu) (cpu->instruction->mode == MODE_ACCUMULATOR)
 
 static uint8_t read_addr(d6502_t * cpu) {
-    return cpu->read(cpu->addr);
+    if (cpu->instruction->mode == MODE_IMMEDIATE) {
+        return cpu->operand; // already read by fetch()
+    }
+    return read8(cpu, cpu->addr);
 }
 
 static void push8(d6502_t *cpu, uint8_t dat) {
-    cpu->write(0x100 + cpu->sp, dat);
+    write8(cpu, 0x100 + cpu->sp, dat);
     cpu->sp--;
 }
 
@@ -23,7 +25,7 @@ static void push16(d6502_t *cpu, uint16_t dat) {
 
 static uint8_t pull8(d6502_t *cpu) {
     cpu->sp++;
-    return cpu->read(0x100 + cpu->sp);
+    return read8(cpu, 0x100 + cpu->sp);
 }
 
 static uint16_t pull16(d6502_t *cpu) {
@@ -40,11 +42,19 @@ static void branch_on_condition(d6502_t *cpu, bool condition) {
     }
 }
 
+// stores and read-modify-write instructions always do the read at the
+// unfixed address, their base timing includes the page crossing
+static void fixed_timing(d6502_t *cpu) {
+    if (cpu->extra_clocks > 0) {
+        cpu->extra_clocks--;
+    }
+}
+
 void ADC(d6502_t *cpu) { // add with carry
     uint8_t src = read_addr(cpu);
     unsigned int temp = src + cpu->a + (get_flag(cpu, FLAG_C) ? 1 : 0);
-    set_flag(cpu, FLAG_Z, (temp & 0xff) == 0);	/* This is not valid in decimal mode */
     if (ENABLE_DECIMAL_MODE && get_flag(cpu, FLAG_D)) {
+        set_flag(cpu, FLAG_Z, (temp & 0xff) == 0);	/* This is not valid in decimal mode */
         if (((cpu->a & 0xf) + (src & 0xf) + (get_flag(cpu, FLAG_C) ? 1 : 0)) > 9) {
             temp += 6;
         }
@@ -55,8 +65,8 @@ void ADC(d6502_t *cpu) { // add with carry
         }
         set_flag(cpu, FLAG_C, temp > 0x99);
     } else {
-        set_flag(cpu, FLAG_N, temp & 0x80);
-        set_flag(cpu, FLAG_V, !((cpu->a ^ src) & 0x80) && ((cpu->a ^ temp) & 0x80));
+        set_nz(cpu, temp);
+        set_overflow(cpu, ~(cpu->a ^ src) & (cpu->a ^ temp));
         set_flag(cpu, FLAG_C, temp > 0xff);
     }
     cpu->a = (uint8_t) temp;
@@ -65,20 +75,19 @@ void ADC(d6502_t *cpu) { // add with carry
 void AND(d6502_t *cpu) { // logical and
     uint8_t op = read_addr(cpu);
     cpu->a = op & cpu->a;
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) != 0);
+    set_nz(cpu, cpu->a);
 }
 
 void ASL(d6502_t *cpu) { // arithmetic shift left
     uint8_t src = (IS_ACC_ADDRESSING(cpu)) ? cpu->a : read_addr(cpu);
     set_flag(cpu, FLAG_C, src & 0x80);
     src = src << 1;
-    set_flag(cpu, FLAG_Z, src == 0);
-    set_flag(cpu, FLAG_N, (src & 0x80) != 0);
+    set_nz(cpu, src);
     if( IS_ACC_ADDRESSING(cpu) ) {
         cpu->a = src;
     } else {
-        cpu->write(cpu->addr, src);
+        write8(cpu, cpu->addr, src);
+        fixed_timing(cpu);
     }
 }
 
@@ -121,7 +130,7 @@ void BRK(d6502_t *cpu) { // Force Break and interrupt/nmi
     // http://visual6502.org/wiki/index.php?title=6502_BRK_and_B_bit
     // software instructions BRK & PHP will push the B flag as being 1
     // hardware interrupts IRQ & NMI will push the B flag as being 0
-    uint8_t st = cpu->st | (intr ? 0 : FLAG_B);
+    uint8_t st = get_status(cpu) | (intr ? 0 : FLAG_B);
     push8(cpu, st);
     set_flag(cpu, FLAG_I, 1);
     if (cpu->nmi) { // NMI has higher prio
@@ -159,8 +168,7 @@ void CMP(d6502_t *cpu) { // Compare memory and accumulator
     uint16_t a = cpu->a;
     m = a - m;
     set_flag(cpu, FLAG_C, m < 0x100);
-    set_flag(cpu, FLAG_N, (m & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, m == 0);
+    set_nz(cpu, m);
 }
 
 void CPX(d6502_t *cpu) { // Compare Memory and Index X
@@ -168,8 +176,7 @@ void CPX(d6502_t *cpu) { // Compare Memory and Index X
     uint16_t x = cpu->x;
     m = x - m;
     set_flag(cpu, FLAG_C, m < 0x100);
-    set_flag(cpu, FLAG_N, (m & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, m == 0);
+    set_nz(cpu, m);
 }
 
 void CPY(d6502_t *cpu) { // Compare memory and index Y
@@ -177,53 +184,47 @@ void CPY(d6502_t *cpu) { // Compare memory and index Y
     uint16_t y = cpu->y;
     m = y - m;
     set_flag(cpu, FLAG_C, m < 0x100);
-    set_flag(cpu, FLAG_N, (m & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, m == 0);
+    set_nz(cpu, m);
 }
 
 void DEC(d6502_t *cpu) { // Decrement memory by one
     uint8_t m = read_addr(cpu) - 1;
-    set_flag(cpu, FLAG_N, (m & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, m == 0);
-    cpu->write(cpu->addr, m);
+    set_nz(cpu, m);
+    write8(cpu, cpu->addr, m);
+    fixed_timing(cpu);
 }
 
 void DEX(d6502_t *cpu) { // Decrement index X by one
     cpu->x--;
-    set_flag(cpu, FLAG_N, (cpu->x & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->x == 0);
+    set_nz(cpu, cpu->x);
 }
 
 void DEY(d6502_t *cpu) { // Decrement index Y by one
     cpu->y--;
-    set_flag(cpu, FLAG_N, (cpu->y & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->y == 0);
+    set_nz(cpu, cpu->y);
 }
 
 void EOR(d6502_t *cpu) { // "Exclusive-Or" memory with accumulator
     uint8_t m = read_addr(cpu);
     cpu->a ^= m;
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
+    set_nz(cpu, cpu->a);
 }
 
 void INC(d6502_t *cpu) { // Increment memory by one
     uint8_t m = read_addr(cpu) + 1;
-    set_flag(cpu, FLAG_N, (m & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, m == 0);
-    cpu->write(cpu->addr, m);
+    set_nz(cpu, m);
+    write8(cpu, cpu->addr, m);
+    fixed_timing(cpu);
 }
 
 void INX(d6502_t *cpu) { // Increment Index X by one
     cpu->x++;
-    set_flag(cpu, FLAG_N, (cpu->x & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->x == 0);
+    set_nz(cpu, cpu->x);
 }
 
 void INY(d6502_t *cpu) { // Increment Index Y by one
     cpu->y++;
-    set_flag(cpu, FLAG_N, (cpu->y & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->y == 0);
+    set_nz(cpu, cpu->y);
 }
 
 void JMP(d6502_t *cpu) { // Jump to new location
@@ -237,20 +238,17 @@ void JSR(d6502_t *cpu) { // Jump to new location saving return address
 
 void LDA(d6502_t *cpu) { // Load accumulator with memory
     cpu->a = read_addr(cpu);
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
+    set_nz(cpu, cpu->a);
 }
 
 void LDX(d6502_t *cpu) { // Load index X with memory
     cpu->x = read_addr(cpu);
-    set_flag(cpu, FLAG_N, (cpu->x & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->x == 0);
+    set_nz(cpu, cpu->x);
 }
 
 void LDY(d6502_t *cpu) { // Load index Y with memory
     cpu->y = read_addr(cpu);
-    set_flag(cpu, FLAG_N, (cpu->y & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->y == 0);
+    set_nz(cpu, cpu->y);
 }
 
 void LSR(d6502_t *cpu) { // Shift right one bit (memory or accumulator)
@@ -260,10 +258,10 @@ void LSR(d6502_t *cpu) { // Shift right one bit (memory or accumulator)
     if (IS_ACC_ADDRESSING(cpu)) {
         cpu->a = m;
     } else {
-        cpu->write(cpu->addr, m);
+        write8(cpu, cpu->addr, m);
+        fixed_timing(cpu);
     }
-    set_flag(cpu, FLAG_Z, m == 0);
-    set_flag(cpu, FLAG_N, 0);
+    set_nz(cpu, m); // N is always 0
 }
 
 void NOP(d6502_t *cpu) { // No operation
@@ -272,8 +270,7 @@ void NOP(d6502_t *cpu) { // No operation
 void ORA(d6502_t *cpu) { // "OR" memory with accumulator
     uint8_t m = read_addr(cpu);
     cpu->a = cpu->a | m;
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
+    set_nz(cpu, cpu->a);
 }
 
 void PHA(d6502_t *cpu) { // Push accumulator on stack 
@@ -281,19 +278,18 @@ void PHA(d6502_t *cpu) { // Push accumulator on stack
 }
 
 void PHP(d6502_t *cpu) { // Push processor status on stack
-    push8(cpu, cpu->st | FLAG_B);
+    push8(cpu, get_status(cpu) | FLAG_B);
 }
 
 void PLA(d6502_t *cpu) { // Pull accumulator from stack
     cpu->a = pull8(cpu);
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
+    set_nz(cpu, cpu->a);
 }
 
 void PLP(d6502_t *cpu) { // Pull processor status from stack
     uint8_t status = pull8(cpu) & ~FLAG_B;
     status |= FLAG_R; // FLAG_R is always set
-    cpu->st = status;
+    set_status(cpu, status);
 }
 
 void ROL(d6502_t *cpu) { // Rotate one bit left (memory or accumulator)
@@ -301,12 +297,12 @@ void ROL(d6502_t *cpu) { // Rotate one bit left (memory or accumulator)
     m = (m << 1) | (get_flag(cpu, FLAG_C) ? 1 : 0);
     set_flag(cpu, FLAG_C, m > 0xff );
     m &= 0xFF;
-    set_flag(cpu, FLAG_N, (m & 0x80) != 0);
-    set_flag(cpu, FLAG_Z, m == 0);
+    set_nz(cpu, m);
     if (IS_ACC_ADDRESSING(cpu)) {
         cpu->a = (uint8_t)m;
     } else {
-        cpu->write(cpu->addr, m);
+        write8(cpu, cpu->addr, m);
+        fixed_timing(cpu);
     }
 }
 
@@ -315,17 +311,17 @@ void ROR(d6502_t *cpu) { // Rotate one bit right (memory or accumulator)
     m |= get_flag(cpu, FLAG_C) ? 0x100 : 0;
     set_flag(cpu, FLAG_C, m & 1); // put old bit 0 to carry flag
     m = (m >> 1);
-    set_flag(cpu, FLAG_Z, m == 0);
-    set_flag(cpu, FLAG_N, (m & 0x80) != 0);
+    set_nz(cpu, m);
     if (IS_ACC_ADDRESSING(cpu)) {
         cpu->a = (uint8_t)m;
     } else {
-        cpu->write(cpu->addr, m);
+        write8(cpu, cpu->addr, m);
+        fixed_timing(cpu);
     }
 }
 
 void RTI(d6502_t *cpu) { // RTI Return from interrupt
-    cpu->st = pull8(cpu) | FLAG_R;
+    set_status(cpu, pull8(cpu) | FLAG_R);
     cpu->pc = pull16(cpu) - cpu->instruction->len;
 }
 
@@ -337,9 +333,8 @@ void RTS(d6502_t *cpu) { // Return from subroutine
 void SBC(d6502_t *cpu) { // Subtract memory from accumulator with borrow
     uint8_t m = read_addr(cpu);
     unsigned int temp = cpu->a - m - (get_flag(cpu, FLAG_C) ? 0 : 1);
-    set_flag(cpu, FLAG_N, temp & 0x80);
-    set_flag(cpu, FLAG_Z, (temp & 0xff) == 0);	/* Sign and Zero are invalid in decimal mode */
-    set_flag(cpu, FLAG_V, ((cpu->a ^ temp) & 0x80) && ((cpu->a ^ m) & 0x80));
+    set_nz(cpu, temp);	/* Sign and Zero are invalid in decimal mode */
+    set_overflow(cpu, (cpu->a ^ temp) & (cpu->a ^ m));
     if (ENABLE_DECIMAL_MODE && get_flag(cpu, FLAG_D)) {
         if ( ((cpu->a & 0xf) - (get_flag(cpu, FLAG_C) ? 0 : 1)) < (m & 0xf)) /* EP */
             temp -= 6;
@@ -363,43 +358,36 @@ void SEI(d6502_t *cpu) { // Set interrupt disable status
 }
 
 void STA(d6502_t *cpu) { // Store accumulator in memory
-    cpu->write(cpu->addr, cpu->a);
-    if (cpu->extra_clocks > 0) {
-        // STA never has extra clock cycles due to page crossing
-        cpu->extra_clocks--;
-    }
+    write8(cpu, cpu->addr, cpu->a);
+    fixed_timing(cpu);
 }
 
 void STX(d6502_t *cpu) { // Store index X in memory
-    cpu->write(cpu->addr, cpu->x);
+    write8(cpu, cpu->addr, cpu->x);
 }
 
 void STY(d6502_t *cpu) { // Store index Y in memory
-    cpu->write(cpu->addr, cpu->y);
+    write8(cpu, cpu->addr, cpu->y);
 }
 
 void TAX(d6502_t *cpu) { // Transfer accumulator to index X
     cpu->x = cpu->a;
-    set_flag(cpu, FLAG_N, (cpu->x & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->x == 0);
+    set_nz(cpu, cpu->x);
 }
 
 void TAY(d6502_t *cpu) { // Transfer accumulator to index Y
     cpu->y = cpu->a;
-    set_flag(cpu, FLAG_N, (cpu->y & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->y == 0);
+    set_nz(cpu, cpu->y);
 }
 
 void TSX(d6502_t *cpu) { // Transfer stack pointer to index X
     cpu->x = cpu->sp;
-    set_flag(cpu, FLAG_N, (cpu->x & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->x == 0);
+    set_nz(cpu, cpu->x);
 }
 
 void TXA(d6502_t *cpu) { // Transfer index X to accumulator
     cpu->a = cpu->x;
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
+    set_nz(cpu, cpu->a);
 }
 
 void TXS(d6502_t *cpu) { // Transfer index X to stack pointer
@@ -408,27 +396,24 @@ void TXS(d6502_t *cpu) { // Transfer index X to stack pointer
 
 void TYA(d6502_t *cpu) { // Transfer index Y to accumulator
     cpu->a = cpu->y;
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
+    set_nz(cpu, cpu->a);
 }
 
 void LAX(d6502_t *cpu) { // illegal: LDA then TAX
     cpu->a = read_addr(cpu);
     cpu->x = cpu->a;
-    set_flag(cpu, FLAG_N, (cpu->a & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, cpu->a == 0);
+    set_nz(cpu, cpu->a);
 }
 
 void SAX(d6502_t *cpu) { // illegal: mem = (A & X)
-    cpu->write(cpu->addr, cpu->a & cpu->x);
+    write8(cpu, cpu->addr, cpu->a & cpu->x);
 }
 
 void iSBC(d6502_t *cpu) {
     uint8_t m = read_addr(cpu);
     unsigned int temp = cpu->a - m - (get_flag(cpu, FLAG_C) ? 0 : 1);
-    set_flag(cpu, FLAG_N, temp & 0x80);
-    set_flag(cpu, FLAG_Z, (temp & 0xff) == 0);	/* Sign and Zero are invalid in decimal mode */
-    set_flag(cpu, FLAG_V, ((cpu->a ^ temp) & 0x80) && ((cpu->a ^ m) & 0x80));
+    set_nz(cpu, temp);	/* Sign and Zero are invalid in decimal mode */
+    set_overflow(cpu, (cpu->a ^ temp) & (cpu->a ^ m));
     set_flag(cpu, FLAG_C, temp < 0x100);
     cpu->a = (temp & 0xff);
 }
@@ -436,16 +421,16 @@ void iSBC(d6502_t *cpu) {
 void DCP(d6502_t *cpu) {
     // TODO not working properly
     uint8_t m = read_addr(cpu);
-    cpu->write(cpu->addr, m-1);
+    write8(cpu, cpu->addr, m-1);
     uint16_t a = cpu->a;
     m = a - m;
-    set_flag(cpu, FLAG_N, (m & 0x80) > 0);
-    set_flag(cpu, FLAG_Z, m == 0);
+    set_nz(cpu, m);
+    fixed_timing(cpu);
 }
 
 void ILL(d6502_t *cpu) { // illegal
 }
 
 void END(d6502_t *cpu) { // end emulator
-    EMULATION_END = 1;
+    cpu->halt = D6502_HALT_END;
 }
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include "d6502.h"
+#include "d6502_private.h"
+
+// Profiler. profile_record() runs after every instruction executed by
+// step(). It adds the cycles of the instruction, including page crossing
+// and taken branch cycles, to its pc and to the current node of the
+// calling context tree.
+//
+// JSR, BRK and serviced interrupts enter a child node of the current node,
+// keyed by the entry address and kind. The stack pointer from before the
+// call is kept with every frame. RTS and RTI leave all frames whose stack
+// pointer is at or below the one after the return. This also unwinds
+// routines which drop their return address and return to their caller's
+// caller.
+
+#define OP_BRK 0x00
+#define OP_JSR 0x20
+#define OP_RTI 0x40
+#define OP_RTS 0x60
+
+static void enter(d6502_profile_t *p, uint16_t addr, uint8_t kind, uint8_t sp) {
+    if (p->depth + 1 == D6502_PROFILE_DEPTH) {
+        // too deep, charge the callee to the caller
+        return;
+    }
+    int parent = p->frames[p->depth].node;
+    int node = p->nodes[parent].child;
+    while (node >= 0 && (p->nodes[node].addr != addr || p->nodes[node].kind != kind)) {
+        node = p->nodes[node].sibling;
+    }
+    if (node < 0 && p->node_count < p->max_nodes) {
+        node = p->node_count++;
+        d6502_profile_node_t *n = &p->nodes[node];
+        n->addr = addr;
+        n->kind = kind;
+        n->parent = parent;
+        n->child = -1;
+        n->sibling = p->nodes[parent].child;
+        n->calls = 0;
+        n->cycles = 0;
+        p->nodes[parent].child = node;
+    }
+    if (node < 0) {
+        // out of nodes, charge the callee to the caller
+        node = parent;
+    }
+    p->depth++;
+    p->frames[p->depth].node = node;
+    p->frames[p->depth].sp = sp;
+    p->nodes[node].calls++;
+}
+
+static void leave(d6502_profile_t *p, uint8_t sp) {
+    while (p->depth > 0 && p->frames[p->depth].sp <= sp) {
+        p->depth--;
+    }
+}
+
+void profile_record(d6502_t *cpu, uint16_t pc, bool serviced) {
+    d6502_profile_t *p = cpu->profile;
+    uint8_t cycles = cpu->current_cycle;
+    if (!serviced) {
+        p->count[pc]++;
+        p->cycles[pc] += cycles;
+    }
+    p->nodes[p->frames[p->depth].node].cycles += cycles;
+    switch (cpu->instruction->opcode) {
+        case OP_JSR:
+            enter(p, cpu->pc, D6502_PROFILE_CALL, cpu->sp + 2);
+            break;
+        case OP_BRK: {
+            // nmi and interrupt are acknowledged after this
+            uint8_t kind = !serviced ? D6502_PROFILE_BRK : cpu->nmi ? D6502_PROFILE_NMI : D6502_PROFILE_IRQ;
+            enter(p, cpu->pc, kind, cpu->sp + 3);
+            break;
+        }
+        case OP_RTS:
+        case OP_RTI:
+            leave(p, cpu->sp);
+            break;
+    }
+}
+
+void d6502_profile_attach(d6502_t *cpu, d6502_profile_t *profile, d6502_profile_node_t *nodes, int max_nodes) {
+    if (profile) {
+        for (int i = 0; i < 0x10000; i++) {
+            profile->count[i] = 0;
+            profile->cycles[i] = 0;
+        }
+        profile->nodes = nodes;
+        profile->max_nodes = max_nodes;
+        profile->node_count = 1;
+        // root, the code running when the profile was attached
+        nodes[0].addr = cpu->pc;
+        nodes[0].kind = D6502_PROFILE_ROOT;
+        nodes[0].parent = -1;
+        nodes[0].child = -1;
+        nodes[0].sibling = -1;
+        nodes[0].calls = 1;
+        nodes[0].cycles = 0;
+        profile->depth = 0;
+        profile->frames[0].node = 0;
+        profile->frames[0].sp = 0xff;
+    }
+    cpu->profile = profile;
+}
+
+uint64_t d6502_profile_inclusive(const d6502_profile_t *profile, int node) {
+    uint64_t cycles = profile->nodes[node].cycles;
+    for (int c = profile->nodes[node].child; c >= 0; c = profile->nodes[c].sibling) {
+        cycles += d6502_profile_inclusive(profile, c);
+    }
+    return cycles;
+}
+
+static int frame_name(const d6502_profile_node_t *n, char *s) {
+    static const char *const kinds[] = {
+        [D6502_PROFILE_ROOT] = "",
+        [D6502_PROFILE_CALL] = "",
+        [D6502_PROFILE_BRK] = "brk ",
+        [D6502_PROFILE_IRQ] = "irq ",
+        [D6502_PROFILE_NMI] = "nmi ",
+    };
+    return sprintf(s, "%s$%04X", kinds[n->kind], n->addr);
+}
+
+// writes the nodes below 'node', 'path' holds the frames up to 'node'
+static bool save_node(FILE *f, const d6502_profile_t *profile, int node, char *path, int len) {
+    const d6502_profile_node_t *n = &profile->nodes[node];
+    if (len > 0) {
+        path[len++] = ';';
+    }
+    len += frame_name(n, path + len);
+    if (n->cycles > 0 && fprintf(f, "%.*s %llu\n", len, path, (unsigned long long)n->cycles) < 0) {
+        return false;
+    }
+    for (int c = n->child; c >= 0; c = profile->nodes[c].sibling) {
+        if (!save_node(f, profile, c, path, len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool d6502_profile_save(const d6502_profile_t *profile, const char *fn) {
+    FILE *f = fopen(fn, "w");
+    if (f == NULL) {
+        return false;
+    }
+    // a frame name is at most 10 characters plus ';'
+    char path[D6502_PROFILE_DEPTH * 11 + 1];
+    bool ok = save_node(f, profile, 0, path, 0);
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+#include "d6502.h"
+#include "d6502_private.h"
+
+// Rewind buffer. 'shadow' holds the memory at the newest snapshot. Taking
+// a snapshot stores the shadow contents of every page changed since then
+// as a backward delta in the pool and copies the page into the shadow.
+// Restoring first copies the dirty pages back from the shadow (back to the
+// newest snapshot), then applies the deltas of the newer snapshots, newest
+// first. Snapshots and their deltas are both kept in rings, dropped oldest
+// first when full and newest first when restoring.
+//
+// A page is dirty if write8() marked it in cpu->dirty or the host reported
+// it with d6502_rewind_touch(). Both are cleared together.
+
+bool d6502_rewind_init(d6502_rewind_t *rw, uint8_t *mem, int snapshots, int pool_pages) {
+    if (pool_pages < 256) {
+        pool_pages = 256;
+    }
+    rw->mem = mem;
+    memcpy(rw->shadow, mem, sizeof(rw->shadow));
+    memset(rw->dirty, 0, sizeof(rw->dirty));
+    rw->snapshots = malloc(snapshots * sizeof(*rw->snapshots));
+    rw->max_snapshots = snapshots;
+    rw->oldest = 0;
+    rw->snapshot_count = 0;
+    rw->pool = malloc(pool_pages * sizeof(*rw->pool));
+    rw->pool_page = malloc(pool_pages);
+    rw->pool_size = pool_pages;
+    rw->pool_head = 0;
+    rw->pool_tail = 0;
+    if (rw->snapshots == NULL || rw->pool == NULL || rw->pool_page == NULL || snapshots < 1) {
+        d6502_rewind_free(rw);
+        return false;
+    }
+    return true;
+}
+
+void d6502_rewind_free(d6502_rewind_t *rw) {
+    free(rw->snapshots);
+    free(rw->pool);
+    free(rw->pool_page);
+    rw->snapshots = NULL;
+    rw->pool = NULL;
+    rw->pool_page = NULL;
+}
+
+void d6502_rewind_touch(d6502_rewind_t *rw, uint16_t addr, int len) {
+    for (int page = addr >> 8; len > 0 && page < 256; page++) {
+        rw->dirty[page] = true;
+        len -= 0x100 - (addr & 0xff);
+        addr = 0;
+    }
+}
+
+static d6502_rewind_snapshot_t *snapshot(d6502_rewind_t *rw, int i) {
+    return &rw->snapshots[(rw->oldest + i) % rw->max_snapshots];
+}
+
+static void drop_oldest(d6502_rewind_t *rw) {
+    rw->oldest++;
+    rw->snapshot_count--;
+    rw->pool_tail = rw->snapshot_count ? snapshot(rw, 0)->first : rw->pool_head;
+}
+
+// takes the pages written by the cpu into rw->dirty
+static void collect(d6502_t *cpu, d6502_rewind_t *rw) {
+    for (int page = 0; page < 256; page++) {
+        rw->dirty[page] |= cpu->dirty[page];
+        cpu->dirty[page] = false;
+    }
+}
+
+void d6502_rewind_snapshot(d6502_t *cpu, d6502_rewind_t *rw) {
+    uint32_t count = 0;
+    collect(cpu, rw);
+    for (int page = 0; page < 256; page++) {
+        if (rw->dirty[page] && memcmp(&rw->shadow[page << 8], &rw->mem[page << 8], 0x100) == 0) {
+            rw->dirty[page] = false; // written, but unchanged
+        }
+        count += rw->dirty[page];
+    }
+    while (rw->snapshot_count > 0 && (rw->snapshot_count == rw->max_snapshots
+        || rw->pool_head - rw->pool_tail + count > rw->pool_size)) {
+        drop_oldest(rw);
+    }
+    d6502_rewind_snapshot_t *s = snapshot(rw, rw->snapshot_count++);
+    s->first = rw->pool_head;
+    s->count = count;
+    for (int page = 0; page < 256; page++) {
+        if (rw->dirty[page]) {
+            uint32_t slot = rw->pool_head++ % rw->pool_size;
+            memcpy(rw->pool[slot], &rw->shadow[page << 8], 0x100);
+            rw->pool_page[slot] = page;
+            memcpy(&rw->shadow[page << 8], &rw->mem[page << 8], 0x100);
+            rw->dirty[page] = false;
+        }
+    }
+    d6502_save_state(cpu, s->state, sizeof(s->state));
+}
+
+bool d6502_rewind_restore(d6502_t *cpu, d6502_rewind_t *rw, int back) {
+    if (back < 0 || back >= rw->snapshot_count) {
+        return false;
+    }
+    collect(cpu, rw);
+    for (int page = 0; page < 256; page++) {
+        if (rw->dirty[page]) {
+            memcpy(&rw->mem[page << 8], &rw->shadow[page << 8], 0x100);
+            d6502_invalidate(cpu, page << 8, 0x100);
+            rw->dirty[page] = false;
+        }
+    }
+    for (int i = 0; i < back; i++) {
+        d6502_rewind_snapshot_t *s = snapshot(rw, --rw->snapshot_count);
+        for (uint32_t j = s->first; j < s->first + s->count; j++) {
+            uint32_t slot = j % rw->pool_size;
+            int page = rw->pool_page[slot];
+            memcpy(&rw->mem[page << 8], rw->pool[slot], 0x100);
+            memcpy(&rw->shadow[page << 8], rw->pool[slot], 0x100);
+            d6502_invalidate(cpu, page << 8, 0x100);
+        }
+        rw->pool_head = s->first;
+    }
+    d6502_rewind_snapshot_t *s = snapshot(rw, rw->snapshot_count - 1);
+    return d6502_load_state(cpu, s->state, sizeof(s->state));
+}
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "d6502.h"
+
+// Job runner. Every worker thread owns a cpu, 64KB of memory, a block
+// cache and a trace buffer, which are reused for all jobs it runs, so jobs
+// share nothing. Each worker has its own queue of jobs. submit() deals the
+// jobs out round robin, a worker takes its newest job first and steals the
+// oldest job of another worker when its own queue is empty. Idle workers
+// sleep until jobs are submitted.
+
+typedef struct {
+    d6502_job_t *jobs; // ring of 'capacity' jobs
+    int capacity;
+    int head; // oldest job
+    int count;
+    pthread_mutex_t lock;
+} queue_t;
+
+typedef struct {
+    d6502_runner_t *runner;
+    int index;
+    pthread_t thread;
+    bool started;
+    queue_t queue;
+
+    d6502_t cpu;
+    uint8_t memory[0x10000];
+    d6502_block_cache_t blocks;
+    d6502_trace_t trace;
+    d6502_trace_record_t *records;
+
+    d6502_job_t job; // the job being run
+    int input; // next entry of job.inputs
+} worker_t;
+
+struct d6502_runner_s {
+    worker_t **workers;
+    int threads;
+    uint32_t trace_size;
+    int next; // worker which gets the next submitted job
+
+    pthread_mutex_t lock; // protects the fields below
+    pthread_cond_t work; // signalled when jobs are submitted or on shutdown
+    pthread_cond_t idle; // signalled when the last pending job is done
+    int queued; // jobs in all queues
+    int pending; // jobs submitted and not done yet
+    bool quit;
+};
+
+static bool push(queue_t *q, const d6502_job_t *job) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity) {
+        int capacity = q->capacity ? 2 * q->capacity : 16;
+        d6502_job_t *jobs = malloc(capacity * sizeof(d6502_job_t));
+        if (jobs == NULL) {
+            pthread_mutex_unlock(&q->lock);
+            return false;
+        }
+        for (int i = 0; i < q->count; i++) {
+            jobs[i] = q->jobs[(q->head + i) % q->capacity];
+        }
+        free(q->jobs);
+        q->jobs = jobs;
+        q->capacity = capacity;
+        q->head = 0;
+    }
+    q->jobs[(q->head + q->count++) % q->capacity] = *job;
+    pthread_mutex_unlock(&q->lock);
+    return true;
+}
+
+// takes the newest job (own queue) or the oldest job (stealing)
+static bool pop(queue_t *q, d6502_job_t *job, bool steal) {
+    pthread_mutex_lock(&q->lock);
+    bool found = q->count > 0;
+    if (found) {
+        if (steal) {
+            *job = q->jobs[q->head];
+            q->head = (q->head + 1) % q->capacity;
+        } else {
+            *job = q->jobs[(q->head + q->count - 1) % q->capacity];
+        }
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return found;
+}
+
+// pages outside the image are RAM, so only writes to ROM get here
+static void ignore_write(void *userdata, uint16_t addr, uint8_t dat) {
+}
+
+static uint8_t read_memory(void *userdata, uint16_t addr) {
+    return ((uint8_t *)userdata)[addr];
+}
+
+// event callback, applies the inputs which are due and schedules the next
+static void apply_inputs(d6502_t *cpu, void *arg) {
+    worker_t *w = arg;
+    const d6502_job_t *job = &w->job;
+    while (w->input < job->input_count && job->inputs[w->input].when <= d6502_cycles(cpu)) {
+        const d6502_input_t *in = &job->inputs[w->input++];
+        w->memory[in->addr] = in->value;
+        if (cpu->page_flags[in->addr >> 8] & D6502_PAGE_IMMUTABLE) {
+            d6502_invalidate(cpu, in->addr, 1);
+        }
+    }
+    if (w->input < job->input_count) {
+        d6502_schedule(cpu, job->inputs[w->input].when, apply_inputs, w);
+    }
+}
+
+static void run_job(worker_t *w) {
+    const d6502_job_t *job = &w->job;
+    d6502_t *cpu = &w->cpu;
+    int size = job->image_size;
+    if (size > 0x10000 - job->image_addr) {
+        size = 0x10000 - job->image_addr;
+    }
+    memset(w->memory, 0, sizeof(w->memory));
+    if (size > 0) {
+        memcpy(w->memory + job->image_addr, job->image, size);
+    }
+
+    d6502_init(cpu);
+    cpu->read = read_memory;
+    cpu->write = ignore_write;
+    cpu->userdata = w->memory;
+    cpu->engine = job->engine;
+    d6502_map_ram(cpu, 0, 256, w->memory);
+    if (job->rom && size > 0) {
+        // whole pages of the image
+        int first = job->image_addr >> 8;
+        int pages = ((job->image_addr + size - 1) >> 8) - first + 1;
+        d6502_map_rom(cpu, first, pages, w->memory + (first << 8));
+        d6502_set_immutable(cpu, first, pages, true);
+        d6502_blocks_attach(cpu, &w->blocks);
+    }
+    d6502_reset(cpu);
+    if (job->start >= 0) {
+        cpu->pc = job->start;
+    }
+    if (w->records) {
+        d6502_trace_attach(cpu, &w->trace, w->records, w->runner->trace_size);
+    }
+    w->input = 0;
+    if (job->input_count > 0) {
+        d6502_schedule(cpu, job->inputs[0].when, apply_inputs, w);
+    }
+
+    uint64_t end = d6502_cycles(cpu) + job->cycles;
+    while (!cpu->halt && d6502_cycles(cpu) < end) {
+        uint64_t left = end - d6502_cycles(cpu);
+        d6502_run(cpu, left < (1 << 24) ? (int)left : (1 << 24));
+    }
+
+    if (job->done) {
+        d6502_job_result_t result = {
+            .job = job,
+            .cpu = cpu,
+            .memory = w->memory,
+            .trace = w->records ? &w->trace : NULL,
+            .worker = w->index,
+        };
+        job->done(&result);
+    }
+}
+
+// waits for a job, returns false on shutdown
+static bool next_job(worker_t *w) {
+    d6502_runner_t *r = w->runner;
+    for (;;) {
+        bool found = pop(&w->queue, &w->job, false);
+        for (int i = 1; !found && i < r->threads; i++) {
+            found = pop(&r->workers[(w->index + i) % r->threads]->queue, &w->job, true);
+        }
+        pthread_mutex_lock(&r->lock);
+        if (found) {
+            r->queued--;
+            pthread_mutex_unlock(&r->lock);
+            return true;
+        }
+        while (r->queued == 0 && !r->quit) {
+            pthread_cond_wait(&r->work, &r->lock);
+        }
+        bool quit = r->quit && r->queued == 0;
+        pthread_mutex_unlock(&r->lock);
+        if (quit) {
+            return false;
+        }
+    }
+}
+
+static void *work(void *arg) {
+    worker_t *w = arg;
+    d6502_runner_t *r = w->runner;
+    while (next_job(w)) {
+        run_job(w);
+        pthread_mutex_lock(&r->lock);
+        if (--r->pending == 0) {
+            pthread_cond_broadcast(&r->idle);
+        }
+        pthread_mutex_unlock(&r->lock);
+    }
+    return NULL;
+}
+
+d6502_runner_t *d6502_runner_create(int threads, uint32_t trace_size) {
+    if (threads < 1 || (trace_size & (trace_size - 1)) != 0) {
+        return NULL;
+    }
+    d6502_runner_t *r = calloc(1, sizeof(d6502_runner_t));
+    if (r == NULL) {
+        return NULL;
+    }
+    r->workers = calloc(threads, sizeof(worker_t *));
+    r->trace_size = trace_size;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->work, NULL);
+    pthread_cond_init(&r->idle, NULL);
+    bool ok = r->workers != NULL;
+    for (int i = 0; ok && i < threads; i++) {
+        worker_t *w = calloc(1, sizeof(worker_t));
+        if (w == NULL) {
+            ok = false;
+            break;
+        }
+        w->runner = r;
+        w->index = i;
+        pthread_mutex_init(&w->queue.lock, NULL);
+        r->workers[i] = w;
+        r->threads = i + 1;
+        if (trace_size > 0) {
+            w->records = malloc(trace_size * sizeof(d6502_trace_record_t));
+            ok = w->records != NULL;
+        }
+    }
+    for (int i = 0; ok && i < threads; i++) {
+        ok = pthread_create(&r->workers[i]->thread, NULL, work, r->workers[i]) == 0;
+        r->workers[i]->started = ok;
+    }
+    if (!ok) {
+        d6502_runner_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+bool d6502_runner_submit(d6502_runner_t *r, const d6502_job_t *job) {
+    if (job->image_size < 0 || (job->image == NULL && job->image_size > 0) || job->start > 0xffff) {
+        return false;
+    }
+    pthread_mutex_lock(&r->lock);
+    // counted once it is in the queue, a worker which takes it earlier
+    // waits for the lock to count it down
+    bool ok = push(&r->workers[r->next]->queue, job);
+    if (ok) {
+        r->next = (r->next + 1) % r->threads;
+        r->pending++;
+        r->queued++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    if (ok) {
+        pthread_cond_signal(&r->work);
+    }
+    return ok;
+}
+
+void d6502_runner_wait(d6502_runner_t *r) {
+    pthread_mutex_lock(&r->lock);
+    while (r->pending > 0) {
+        pthread_cond_wait(&r->idle, &r->lock);
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+void d6502_runner_destroy(d6502_runner_t *r) {
+    pthread_mutex_lock(&r->lock);
+    r->quit = true;
+    pthread_cond_broadcast(&r->work);
+    pthread_mutex_unlock(&r->lock);
+    // idle workers steal from all queues, so free them after all joined
+    for (int i = 0; i < r->threads; i++) {
+        if (r->workers[i]->started) {
+            pthread_join(r->workers[i]->thread, NULL);
+        }
+    }
+    for (int i = 0; i < r->threads; i++) {
+        worker_t *w = r->workers[i];
+        pthread_mutex_destroy(&w->queue.lock);
+        free(w->queue.jobs);
+        free(w->records);
+        free(w);
+    }
+    pthread_cond_destroy(&r->work);
+    pthread_cond_destroy(&r->idle);
+    pthread_mutex_destroy(&r->lock);
+    free(r->workers);
+    free(r);
+}
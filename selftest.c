@@ -0,0 +1,214 @@
+#include "d6502.h"
+#include <stdio.h>
+#include <string.h>
+
+// Behaviour checks of the parts of the library which nestest does not
+// cover. Prints every failed check and exits with 1 if any failed, with
+// 0 otherwise.
+//
+// usage: selftest
+
+#define CODE_ADDR 0x0200
+
+#define CHECK(condition) check(condition, #condition, __func__, __LINE__)
+
+static int failed;
+static uint8_t memory[0x10000];
+
+static void check(bool ok, const char *what, const char *func, int line) {
+    if (!ok) {
+        printf("FAIL %s:%d: %s\n", func, line, what);
+        failed++;
+    }
+}
+
+static void writebus(void *userdata, uint16_t addr, uint8_t dat) {
+    ((uint8_t *)userdata)[addr] = dat;
+}
+
+static uint8_t readbus(void *userdata, uint16_t addr) {
+    return ((uint8_t *)userdata)[addr];
+}
+
+// a cpu on 'memory', not reset
+static void attach(d6502_t *cpu) {
+    d6502_init(cpu);
+    cpu->read = readbus;
+    cpu->write = writebus;
+    cpu->userdata = memory;
+    d6502_map_ram(cpu, 0, 256, memory);
+}
+
+// a cpu running 'code' at CODE_ADDR in otherwise zeroed RAM
+static void setup(d6502_t *cpu, const uint8_t *code, int size) {
+    memset(memory, 0, sizeof(memory));
+    memcpy(&memory[CODE_ADDR], code, size);
+    memory[RESET_ADDR] = CODE_ADDR & 0xff;
+    memory[RESET_ADDR + 1] = CODE_ADDR >> 8;
+    attach(cpu);
+    d6502_reset(cpu);
+}
+
+static bool same_cpu(const d6502_t *a, const d6502_t *b) {
+    return a->pc == b->pc && a->a == b->a && a->x == b->x && a->y == b->y
+        && a->st == b->st && a->sp == b->sp && a->halt == b->halt
+        && d6502_cycles(a) == d6502_cycles(b) && d6502_instructions(a) == d6502_instructions(b);
+}
+
+// increments $0300..$03FF, then halts
+static const uint8_t count_loop[] = {
+    0xA2, 0x00,       // LDX #$00
+    0xFE, 0x00, 0x03, // INC $0300,X
+    0xE8,             // INX
+    0xD0, 0xFA,       // BNE $0202
+    0xFF              // END
+};
+
+// read-modify-write abs,X takes 7 cycles with and without page crossing,
+// in every engine and in the per-cycle bus mode
+static void rmw_timing(void) {
+    static const uint8_t code[] = {
+        0xA2, 0x01,       // LDX #$01
+        0xFE, 0xFF, 0x10, // INC $10FF,X
+        0x1E, 0xFF, 0x10  // ASL $10FF,X
+    };
+    for (int mode = 0; mode < 3; mode++) {
+        d6502_t cpu;
+        setup(&cpu, code, sizeof(code));
+        cpu.engine = mode == 1 ? D6502_ENGINE_SWITCH : D6502_ENGINE_TABLE;
+        cpu.bus_mode = mode == 2 ? D6502_BUS_CYCLE : D6502_BUS_INSTRUCTION;
+        uint64_t start = d6502_cycles(&cpu);
+        while (d6502_instructions(&cpu) < 3) {
+            d6502_run(&cpu, 1);
+        }
+        CHECK(d6502_cycles(&cpu) - start == 2 + 7 + 7);
+        CHECK(memory[0x1100] == 2);
+    }
+}
+
+// a snapshot taken in the middle of an instruction continues like the
+// cpu it was taken from, damaged snapshots are rejected
+static void state_round_trip(void) {
+    static uint8_t saved[sizeof(memory)];
+    d6502_t cpu;
+    setup(&cpu, count_loop, sizeof(count_loop));
+    cpu.bus_mode = D6502_BUS_CYCLE;
+    for (int i = 0; i < 1000 || cpu.cycle_pos == 0; i++) {
+        d6502_tick(&cpu);
+    }
+    uint8_t state[D6502_STATE_SIZE];
+    CHECK(d6502_save_state(&cpu, state, sizeof(state)) == D6502_STATE_SIZE);
+    memcpy(saved, memory, sizeof(memory));
+    d6502_run(&cpu, 2000);
+    static uint8_t done[sizeof(memory)];
+    memcpy(done, memory, sizeof(memory));
+
+    memcpy(memory, saved, sizeof(memory));
+    d6502_t copy;
+    attach(&copy);
+    CHECK(d6502_load_state(&copy, state, sizeof(state)));
+    CHECK(copy.bus_mode == D6502_BUS_CYCLE);
+    d6502_run(&copy, 2000);
+    CHECK(same_cpu(&cpu, &copy));
+    CHECK(memcmp(memory, done, sizeof(memory)) == 0);
+
+    CHECK(!d6502_load_state(&copy, state, sizeof(state) - 1));
+    uint8_t damaged[D6502_STATE_SIZE];
+    const int fields[] = { 0, 9, 11, 18, 38 }; // version, halt, extra_clocks, cycle_pos, bus_mode
+    for (int i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++) {
+        memcpy(damaged, state, sizeof(state));
+        damaged[fields[i]] = 0xff;
+        CHECK(!d6502_load_state(&copy, damaged, sizeof(damaged)));
+    }
+    CHECK(same_cpu(&cpu, &copy));
+}
+
+// restoring a snapshot brings back the registers and the memory written
+// since, through direct pages and without a bus hook
+static void rewind_snapshot(void) {
+    static d6502_rewind_t history;
+    static uint8_t saved[sizeof(memory)];
+    d6502_t cpu;
+    setup(&cpu, count_loop, sizeof(count_loop));
+    CHECK(d6502_rewind_init(&history, memory, 4, 256));
+    d6502_run(&cpu, 500);
+    d6502_rewind_snapshot(&cpu, &history);
+    d6502_t before = cpu;
+    memcpy(saved, memory, sizeof(memory));
+    d6502_run(&cpu, 1000);
+    d6502_rewind_snapshot(&cpu, &history);
+    d6502_run(&cpu, 300);
+    CHECK(memcmp(memory, saved, sizeof(memory)) != 0);
+
+    CHECK(d6502_rewind_restore(&cpu, &history, 1));
+    CHECK(same_cpu(&cpu, &before));
+    CHECK(memcmp(memory, saved, sizeof(memory)) == 0);
+    CHECK(history.snapshot_count == 1);
+    CHECK(!d6502_rewind_restore(&cpu, &history, 1));
+    d6502_rewind_free(&history);
+}
+
+// a watched write halts after the instruction, a breakpoint before it
+static void watch_hit(void) {
+    static d6502_watch_t watch;
+    for (int mode = 0; mode < 3; mode++) {
+        d6502_t cpu;
+        setup(&cpu, count_loop, sizeof(count_loop));
+        cpu.engine = mode == 1 ? D6502_ENGINE_SWITCH : D6502_ENGINE_TABLE;
+        cpu.bus_mode = mode == 2 ? D6502_BUS_CYCLE : D6502_BUS_INSTRUCTION;
+        d6502_watch_attach(&cpu, &watch);
+        d6502_watch(&cpu, 0x0310, 1, D6502_WATCH_WRITE, true);
+        d6502_run(&cpu, 100000);
+        CHECK(cpu.halt == D6502_HALT_WATCH);
+        CHECK(watch.hit_addr == 0x0310 && watch.hit_kind == D6502_WATCH_WRITE);
+        CHECK(cpu.pc == CODE_ADDR + 5 && cpu.x == 0x10 && memory[0x0310] == 1);
+
+        d6502_watch(&cpu, 0x0310, 1, D6502_WATCH_WRITE, false);
+        d6502_watch(&cpu, CODE_ADDR + 8, 1, D6502_WATCH_EXEC, true);
+        cpu.halt = D6502_RUNNING;
+        d6502_run(&cpu, 100000);
+        CHECK(cpu.halt == D6502_HALT_BREAK);
+        CHECK(cpu.pc == CODE_ADDR + 8 && memory[0x03ff] == 1);
+        cpu.halt = D6502_RUNNING;
+        d6502_run(&cpu, 100000);
+        CHECK(cpu.halt == D6502_HALT_END);
+    }
+}
+
+// a NES 2.0 header with exponent sizes, PRG and CHR follow the trainer
+static void ines_header(void) {
+    enum { PRG_SIZE = 0x2000 * 3, CHR_SIZE = 0x400 };
+    static uint8_t file[16 + 512 + PRG_SIZE + CHR_SIZE];
+    memcpy(file, "NES\x1a", 4);
+    file[4] = 13 << 2 | 1; // 2^13 * 3
+    file[5] = 10 << 2;     // 2^10 * 1
+    file[6] = 0x14;        // mapper 1, trainer
+    file[7] = 0x08;        // NES 2.0
+    file[9] = 0xff;        // exponent sizes for both
+    file[16] = 0xaa;
+    file[16 + 512] = 0xbb;
+    file[16 + 512 + PRG_SIZE] = 0xcc;
+    d6502_rom_t rom;
+    CHECK(d6502_rom_parse(&rom, file, sizeof(file)));
+    CHECK(rom.nes2 && rom.mapper == 1);
+    CHECK(rom.trainer == file + 16 && rom.trainer[0] == 0xaa);
+    CHECK(rom.prg_size == PRG_SIZE && rom.prg[0] == 0xbb);
+    CHECK(rom.chr_size == CHR_SIZE && rom.chr[0] == 0xcc);
+    CHECK(rom.misc == NULL);
+    CHECK(d6502_rom_prg_bank(&rom, 2, 0x2000) == rom.prg + 0x4000);
+    CHECK(d6502_rom_prg_bank(&rom, 3, 0x2000) == NULL);
+    CHECK(!d6502_rom_parse(&rom, file, sizeof(file) - 1));
+}
+
+int main(void) {
+    rmw_timing();
+    state_round_trip();
+    rewind_snapshot();
+    watch_hit();
+    ines_header();
+    if (failed) {
+        return 1;
+    }
+    printf("PASS selftest\n");
+    return 0;
+}
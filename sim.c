@@ -1,27 +1,33 @@
 #include "d6502.h"
 #include "instruction_table.h"
-#include "inesheader.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 uint8_t memory[0x10000];
 
-int EMULATION_END = 0;
+bool quit = false;
 uint32_t run_count = 0;
-uint16_t breakpoint = 0;
 bool nmi = false;
 bool intr = false;
+d6502_rewind_t history;
+d6502_watch_t watch;
 
-void writebus(uint16_t addr, uint8_t dat) {
+// instructions between two rewind snapshots, "back" executes the
+// instructions after the snapshot it restores again
+#define SNAPSHOT_INTERVAL 100
+
+void writebus(void *userdata, uint16_t addr, uint8_t dat) {
+    uint8_t *mem = userdata;
     switch(addr) {
-        default: memory[addr] = dat;
+        default: mem[addr] = dat;
     }
 }
 
-uint8_t readbus(uint16_t addr) {
+uint8_t readbus(void *userdata, uint16_t addr) {
+    uint8_t *mem = userdata;
     switch(addr) {
-        default: return memory[addr];
+        default: return mem[addr];
     }
     return 0;
 }
@@ -60,10 +66,36 @@ int read_line(char *s, int maxlen)
     return i;
 }
 
+// goes back 'n' instructions, false if the history does not reach back
+// that far (the cpu is at the oldest snapshot then)
+bool go_back(d6502_t *cpu, int n) {
+    if (n < 1 || (uint64_t)n > d6502_instructions(cpu)) {
+        return false;
+    }
+    uint64_t target = d6502_instructions(cpu) - n;
+    if (!d6502_rewind_restore(cpu, &history, 0)) {
+        return false;
+    }
+    while (d6502_instructions(cpu) > target) {
+        if (!d6502_rewind_restore(cpu, &history, 1)) {
+            return false;
+        }
+    }
+    while (d6502_instructions(cpu) < target && cpu->halt != D6502_HALT_END) {
+        // run over breakpoints and watches hit before
+        cpu->halt = D6502_RUNNING;
+        while (d6502_tick(cpu) > 0);
+    }
+    if (cpu->halt != D6502_HALT_END) {
+        cpu->halt = D6502_RUNNING;
+    }
+    return true;
+}
+
 void handle(d6502_t *cpu, const char *cmd) {
     unsigned int addr;
     if (strcmp(cmd, "exit") == 0) {
-        EMULATION_END = 1;
+        quit = true;
     } else if(strstr(cmd, "dump") != 0 && sscanf(cmd, "dump %x", &addr) == 1) {
         memory_dump(addr, 16, 8);
     } else if(strstr(cmd, "regs")) {
@@ -76,7 +108,19 @@ void handle(d6502_t *cpu, const char *cmd) {
             run_count = 0xFFFFffff;
         }
     } else if(strstr(cmd, "break") != 0 && sscanf(cmd, "break %x", &addr) == 1) {
-        breakpoint = addr;
+        d6502_watch(cpu, addr, 1, D6502_WATCH_EXEC, true);
+    } else if(strstr(cmd, "watch") != 0 && sscanf(cmd, "watch %x", &addr) == 1) {
+        d6502_watch(cpu, addr, 1, D6502_WATCH_READ | D6502_WATCH_WRITE, true);
+    } else if(strstr(cmd, "delete") != 0 && sscanf(cmd, "delete %x", &addr) == 1) {
+        d6502_watch(cpu, addr, 1, D6502_WATCH_READ | D6502_WATCH_WRITE | D6502_WATCH_EXEC, false);
+    } else if(strstr(cmd, "back") != 0) {
+        int n = 1;
+        sscanf(cmd, "back %d", &n);
+        if (go_back(cpu, n)) {
+            print_regs(cpu);
+        } else {
+            printf("cannot go back %d instructions\n", n);
+        }
     } else if(strstr(cmd, "nmi") != 0) {
         printf("nmi triggered\n"),
         nmi = true;
@@ -90,11 +134,11 @@ void handle(d6502_t *cpu, const char *cmd) {
 
 void get_raw_instruction(d6502_t *cpu, char raw[]) {
     char temp[10];
-    uint8_t dat = cpu->read(cpu->pc);
+    uint8_t dat = cpu->read(cpu->userdata, cpu->pc);
     sprintf(raw, "%02X", dat);
     const instruction_t *inst = get_instruction(dat);
     for( int i = 1; i < 3/*inst->len*/; i++ ) {
-        dat = cpu->read(cpu->pc + i);
+        dat = cpu->read(cpu->userdata, cpu->pc + i);
         if( i < inst->len)
             sprintf(temp, " %02X", dat);
         else
@@ -127,15 +171,14 @@ int load(uint16_t addr, const char *fn) {
 }
 
 void load_nestest(const char *fn) {
-    FILE *f = fopen(fn, "r");
-    if (f == NULL) {
-        printf("ERROR: File not found.\n");
+    d6502_rom_t rom;
+    if (!d6502_rom_open(&rom, fn) || rom.prg_size > 0x8000) {
+        printf("ERROR: Cannot load %s.\n", fn);
         exit(1);
     }
-    inesheader_t header;
-    fread(&header, 1, sizeof(header), f);
-    fread(&memory[0xc000], header.nPRGROM16k, 16*1024, f);
-    fclose(f);
+    // copied, the reset vector is patched below
+    memcpy(&memory[0x10000 - rom.prg_size], rom.prg, rom.prg_size);
+    d6502_rom_close(&rom);
 }
 
 void write16(uint16_t addr, uint16_t dat) {
@@ -152,32 +195,44 @@ int main(int argc, char *argv[]) {
     d6502_init(&cpu);
     cpu.read = readbus;
     cpu.write = writebus;
+    cpu.userdata = memory;
+    d6502_map_ram(&cpu, 0x00, 256, memory);
     
     write16(RESET_ADDR, 0xc000);
     
     d6502_reset(&cpu);
+    // step back with "back <n>" over the last 100000 instructions
+    d6502_rewind_init(&history, memory, 1000, 1024);
+    // "break <addr>", "watch <addr>" and "delete <addr>"
+    d6502_watch_attach(&cpu, &watch);
 
     FILE *log = fopen("log.txt", "w");
 
-    int instruction_counter = 1;
-    int cyc = 7;
+    uint32_t instruction_counter;
     char asmcode[32];
     char raw[16];
     char logstr[128];
     char buf[256];
-    while( EMULATION_END == 0) {
-        d6502_disassemble(&cpu, cpu.pc, asmcode);
-        get_raw_instruction(&cpu, raw);
+    while( (cpu.halt == D6502_RUNNING || cpu.halt == D6502_HALT_BREAK || cpu.halt == D6502_HALT_WATCH) && !quit) {
+        if (cpu.halt == D6502_HALT_BREAK) {
+            printf("breakpoint at $%04X\n", watch.hit_addr);
+        } else if (cpu.halt == D6502_HALT_WATCH) {
+            printf("%s $%02X at $%04X\n", watch.hit_kind == D6502_WATCH_READ ? "read" : "write",
+                watch.hit_value, watch.hit_addr);
+        }
+        if (cpu.halt != D6502_RUNNING) {
+            // stop running and continue with the next instruction
+            cpu.halt = D6502_RUNNING;
+            run_count = 0;
+        }
         print_regs(&cpu);
         do {
-            printf("\n%d $%04X: %s   %s> ", instruction_counter, cpu.pc, raw, asmcode);
-            if (breakpoint == 0) {
-                if( instruction_counter < run_count ) break;
-            } else if (breakpoint != cpu.pc) {
-                break;
-            } else {
-                breakpoint = 0;
-            }
+            // again after going back
+            instruction_counter = d6502_instructions(&cpu) + 1;
+            d6502_disassemble(&cpu, cpu.pc, asmcode);
+            get_raw_instruction(&cpu, raw);
+            printf("\n%u $%04X: %s   %s> ", instruction_counter, cpu.pc, raw, asmcode);
+            if( instruction_counter < run_count ) break;
             buf[0] = 0;
             read_line(buf, sizeof(buf));
             handle(&cpu, buf);
@@ -188,10 +243,11 @@ int main(int argc, char *argv[]) {
         while( p < 48 ) {
             logstr[p++] = ' ';
         }
-        sprintf(logstr+p, "A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:        CYC:%d\n", cpu.a, cpu.x, cpu.y, cpu.st, cpu.sp, cyc);
-        fwrite(logstr, strlen(logstr), 1, log);
-        fflush(log);
+        sprintf(logstr+p, "A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:        CYC:%lu\n", cpu.a, cpu.x, cpu.y, cpu.st, cpu.sp, (unsigned long)d6502_cycles(&cpu));
 
+        // a snapshot when the nmi/interrupt is pending, going back
+        // executes it again
+        bool raised = intr || nmi;
         if (intr) {
             d6502_interrupt(&cpu);
             intr = false;
@@ -200,13 +256,17 @@ int main(int argc, char *argv[]) {
             d6502_nmi(&cpu);
             nmi = false;
         }
+        if (raised || d6502_instructions(&cpu) % SNAPSHOT_INTERVAL == 0) {
+            d6502_rewind_snapshot(&cpu, &history);
+        }
 
         // execute instruction
-        while( d6502_tick(&cpu) > 0 ) {
-            cyc++;
+        while( d6502_tick(&cpu) > 0 );
+        if (cpu.halt != D6502_HALT_BREAK) {
+            // executed
+            fwrite(logstr, strlen(logstr), 1, log);
+            fflush(log);
         }
-
-        instruction_counter++; // instruction counter
     }
     fclose(log);
 
@@ -0,0 +1,94 @@
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+
+// Snapshot format, version 1, D6502_STATE_SIZE bytes, little endian:
+//
+//   0  version         13 m                 22 cycles (8 bytes)
+//   1  a               14 operand (2)       30 instructions (8 bytes)
+//   2  x               16 addr (2)          38 bus_mode
+//   3  y               18 cycle_pos         39 reserved (0)
+//   4  st              19 cycle_data
+//   5  sp              20 cycle_base (2)
+//   6  pc (2)
+//   8  bit 0: nmi, bit 1: interrupt, bit 2: cycle_irq
+//   9  halt
+//   10 current_cycle
+//   11 extra_clocks
+//   12 opcode of the current instruction
+
+#define STATE_VERSION 1
+
+// a taken branch to another page
+#define MAX_EXTRA_CLOCKS 2
+
+int d6502_save_state(const d6502_t *cpu, uint8_t *buf, int size) {
+    if (size < D6502_STATE_SIZE) {
+        return 0;
+    }
+    buf[0] = STATE_VERSION;
+    buf[1] = cpu->a;
+    buf[2] = cpu->x;
+    buf[3] = cpu->y;
+    // in the middle of a D6502_BUS_CYCLE instruction the unpacked flags are current
+    buf[4] = cpu->cycle_pos ? get_status(cpu) : cpu->st;
+    buf[5] = cpu->sp;
+    put16(buf + 6, cpu->pc);
+    buf[8] = cpu->nmi | (cpu->interrupt << 1) | (cpu->cycle_irq << 2);
+    buf[9] = cpu->halt;
+    buf[10] = cpu->current_cycle;
+    buf[11] = cpu->extra_clocks;
+    buf[12] = cpu->instruction->opcode;
+    buf[13] = cpu->m;
+    put16(buf + 14, cpu->operand);
+    put16(buf + 16, cpu->addr);
+    buf[18] = cpu->cycle_pos;
+    buf[19] = cpu->cycle_data;
+    put16(buf + 20, cpu->cycle_base);
+    put64(buf + 22, cpu->cycles);
+    put64(buf + 30, cpu->instructions);
+    buf[38] = cpu->bus_mode;
+    buf[39] = 0;
+    return D6502_STATE_SIZE;
+}
+
+bool d6502_load_state(d6502_t *cpu, const uint8_t *buf, int size) {
+    if (size < D6502_STATE_SIZE || buf[0] != STATE_VERSION) {
+        return false;
+    }
+    // reject values the engines cannot continue from, the per-cycle
+    // mode indexes its tables with them
+    const instruction_t *instruction = get_instruction(buf[12]);
+    int cycles = instruction->cycles + buf[11];
+    if (buf[9] > D6502_HALT_WATCH || buf[38] > D6502_BUS_CYCLE
+        || buf[11] > MAX_EXTRA_CLOCKS || buf[10] > cycles) {
+        return false;
+    }
+    if (buf[18] && (buf[38] != D6502_BUS_CYCLE || instruction->operation == NULL || buf[18] >= cycles)) {
+        return false;
+    }
+    cpu->a = buf[1];
+    cpu->x = buf[2];
+    cpu->y = buf[3];
+    cpu->st = buf[4];
+    set_status(cpu, cpu->st);
+    cpu->sp = buf[5];
+    cpu->pc = get16(buf + 6);
+    cpu->nmi = buf[8] & 1;
+    cpu->interrupt = (buf[8] >> 1) & 1;
+    cpu->cycle_irq = (buf[8] >> 2) & 1;
+    cpu->halt = buf[9];
+    cpu->current_cycle = buf[10];
+    cpu->extra_clocks = buf[11];
+    cpu->instruction = instruction;
+    cpu->m = buf[13];
+    cpu->operand = get16(buf + 14);
+    cpu->addr = get16(buf + 16);
+    cpu->cycle_pos = buf[18];
+    cpu->cycle_data = buf[19];
+    cpu->cycle_base = get16(buf + 20);
+    cpu->cycles = get64(buf + 22);
+    cpu->instructions = get64(buf + 30);
+    cpu->bus_mode = buf[38];
+    return true;
+}
@@ -0,0 +1,79 @@
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+#include "switch_core.h"
+#include "switch_core_ops.h"
+
+// Alternative interpreter used by d6502_run() when cpu->engine is
+// D6502_ENGINE_SWITCH. Addressing mode and operation of every opcode are
+// fused into one case of a single switch, generated from
+// instruction_table.def. A, X, Y, SP and PC are kept in local variables
+// for the whole batch and written back when d6502_run() returns, so bus
+// callbacks must not rely on these fields of the cpu. The flags stay in
+// the cpu, so d6502_interrupt() sees the current I flag. The cases are
+// made of the macros in switch_core_ops.h.
+
+#define OPERAND8  read8(cpu, pc + 1)
+#define OPERAND16 read16(cpu, pc + 1)
+
+int switch_core_run(d6502_t *cpu, int cycles) {
+    uint8_t a = cpu->a;
+    uint8_t x = cpu->x;
+    uint8_t y = cpu->y;
+    uint8_t sp = cpu->sp;
+    uint16_t pc = cpu->pc;
+    uint16_t addr = cpu->addr;
+    uint8_t opcode = cpu->instruction->opcode;
+    uint8_t extra = 0;
+    int done = 0;
+
+    while (done < cycles && !cpu->halt) {
+        const bool serviced = cpu->nmi || cpu->interrupt;
+        if (serviced) {
+            opcode = 0x00; // BRK opcode
+        } else {
+            opcode = read8(cpu, pc);
+        }
+        const uint16_t start = pc;
+        const uint64_t start_cycles = cpu->cycles;
+        extra = 0;
+        switch (opcode) {
+#define INSTRUCTION(opc, op, mnemonic, am, l, cyc) FUSED_CASE(opc, op, am, l, cyc)
+#include "instruction_table.def"
+#undef INSTRUCTION
+            default: // illegal instruction -> perform NOP
+                opcode = 0xEA;
+                pc += 1;
+                done += 2;
+                cpu->cycles += 2;
+        }
+        cpu->instructions++;
+        if (cpu->profile) {
+            // profile_record() reads the registers after the instruction
+            // from the cpu
+            cpu->pc = pc;
+            cpu->sp = sp;
+            cpu->instruction = get_instruction(opcode);
+            cpu->current_cycle = cpu->cycles - start_cycles;
+            profile_record(cpu, start, serviced);
+            cpu->current_cycle = 0;
+        }
+        if (!serviced) {
+            // raised by a bus callback during this instruction, keep it pending
+        } else if (cpu->nmi) {
+            cpu->nmi = false;
+        } else if (cpu->interrupt) {
+            cpu->interrupt = false;
+        }
+    }
+
+    cpu->a = a;
+    cpu->x = x;
+    cpu->y = y;
+    cpu->sp = sp;
+    cpu->pc = pc;
+    cpu->addr = addr;
+    cpu->instruction = get_instruction(opcode);
+    cpu->extra_clocks = extra;
+    return done;
+}
@@ -0,0 +1,10 @@
+#ifndef __SWITCH_CORE_H
+#define __SWITCH_CORE_H
+
+#include "d6502.h"
+
+// executes whole instructions until at least 'cycles' have passed,
+// returns the number of cycles executed
+int switch_core_run(d6502_t *cpu, int cycles);
+
+#endif
@@ -0,0 +1,232 @@
+#ifndef __SWITCH_CORE_OPS_H
+#define __SWITCH_CORE_OPS_H
+
+#include "d6502_private.h"
+#include "instruction_table.h"
+
+// Fused addressing modes and operations of switch_core.c, shared with the
+// blocks of threaded.c. They work on the locals a, x, y, sp, pc, addr and
+// extra of the function they are expanded in, and on 'cpu'. The includer
+// defines OPERAND8 and OPERAND16, the operand of the instruction at pc.
+//
+// The behaviour must match operations.c and addressing.c exactly.
+
+// addressing modes, set addr (and extra on page crossing)
+#define AM_IMPLIED()
+#define AM_ACCUMULATOR()
+#define AM_IMMEDIATE()   addr = pc + 1
+#define AM_ZEROPAGE()    addr = OPERAND8
+#define AM_ZEROPAGE_X()  addr = (uint8_t)(OPERAND8 + x)
+#define AM_ZEROPAGE_Y()  addr = (uint8_t)(OPERAND8 + y)
+#define AM_ABSOLUTE()    addr = OPERAND16
+#define AM_ABSOLUTE_X()  { uint16_t a1 = OPERAND16; addr = a1 + x; extra += PAGE_WRAP(a1, addr); }
+#define AM_ABSOLUTE_Y()  { uint16_t a1 = OPERAND16; addr = a1 + y; extra += PAGE_WRAP(a1, addr); }
+#define AM_INDIRECT() { \
+    uint16_t imm = OPERAND16; \
+    uint8_t lo = imm & 0xff; \
+    addr = read8(cpu, (imm & 0xff00) | lo++); \
+    addr |= read8(cpu, (imm & 0xff00) | lo) << 8; }
+#define AM_INDIRECT_X() { \
+    uint8_t zp = OPERAND8 + x; \
+    addr = read8(cpu, zp++); \
+    addr |= read8(cpu, zp) << 8; }
+#define AM_INDIRECT_Y() { \
+    uint8_t zp = OPERAND8; \
+    addr = read8(cpu, zp++); \
+    addr |= ((uint16_t)read8(cpu, zp)) << 8; \
+    extra += PAGE_WRAP(addr, addr + y); \
+    addr += y; }
+#define AM_RELATIVE() { \
+    uint16_t im = OPERAND8; \
+    if (im & 0x80) { \
+        im |= 0xFF00; \
+    } \
+    addr = pc + im; }
+
+#define MEM          read8(cpu, addr)
+#define PUSH(v)      write8(cpu, 0x100 + sp--, (v))
+#define PULL()       read8(cpu, 0x100 + ++sp)
+#define SET_NZ(v)    set_nz(cpu, (v))
+#define IS_ACC       (mode == MODE_ACCUMULATOR)
+// stores and read-modify-write, see fixed_timing() in operations.c
+#define FIXED_TIMING() if (extra > 0) extra--
+
+#define BRANCH(condition) \
+    if (condition) { \
+        extra++; \
+        extra += PAGE_WRAP((uint16_t)(pc + len), addr); \
+        pc = addr; \
+    }
+
+#define COMPARE(reg) { \
+    uint16_t m = reg - MEM; \
+    set_flag(cpu, FLAG_C, m < 0x100); \
+    SET_NZ(m); }
+
+#define SBC_BINARY(m) \
+    unsigned int temp = a - m - (get_flag(cpu, FLAG_C) ? 0 : 1); \
+    SET_NZ(temp); \
+    set_overflow(cpu, (a ^ temp) & (a ^ m));
+
+// operations
+#define OP_ADC() { \
+    uint8_t src = MEM; \
+    unsigned int temp = src + a + (get_flag(cpu, FLAG_C) ? 1 : 0); \
+    if (ENABLE_DECIMAL_MODE && get_flag(cpu, FLAG_D)) { \
+        set_flag(cpu, FLAG_Z, (temp & 0xff) == 0); \
+        if (((a & 0xf) + (src & 0xf) + (get_flag(cpu, FLAG_C) ? 1 : 0)) > 9) { \
+            temp += 6; \
+        } \
+        set_flag(cpu, FLAG_N, temp & 0x80); \
+        set_flag(cpu, FLAG_V, !((a ^ src) & 0x80) && ((a ^ temp) & 0x80)); \
+        if (temp > 0x99) { \
+            temp += 96; \
+        } \
+        set_flag(cpu, FLAG_C, temp > 0x99); \
+    } else { \
+        SET_NZ(temp); \
+        set_overflow(cpu, ~(a ^ src) & (a ^ temp)); \
+        set_flag(cpu, FLAG_C, temp > 0xff); \
+    } \
+    a = (uint8_t)temp; }
+#define OP_SBC() { \
+    uint8_t m = MEM; \
+    SBC_BINARY(m) \
+    if (ENABLE_DECIMAL_MODE && get_flag(cpu, FLAG_D)) { \
+        if (((a & 0xf) - (get_flag(cpu, FLAG_C) ? 0 : 1)) < (m & 0xf)) \
+            temp -= 6; \
+        if (temp > 0x99) \
+            temp -= 0x60; \
+    } \
+    set_flag(cpu, FLAG_C, temp < 0x100); \
+    a = temp & 0xff; }
+#define OP_iSBC() { \
+    uint8_t m = MEM; \
+    SBC_BINARY(m) \
+    set_flag(cpu, FLAG_C, temp < 0x100); \
+    a = temp & 0xff; }
+#define OP_AND()  { a &= MEM; SET_NZ(a); }
+#define OP_ORA()  { a |= MEM; SET_NZ(a); }
+#define OP_EOR()  { a ^= MEM; SET_NZ(a); }
+#define OP_BIT() { \
+    uint8_t src = MEM; \
+    set_flag(cpu, FLAG_N, (src & 0x80) != 0); \
+    set_flag(cpu, FLAG_V, (0x40 & src) != 0); \
+    set_flag(cpu, FLAG_Z, (src & a) == 0); }
+#define OP_CMP()  COMPARE(a)
+#define OP_CPX()  COMPARE(x)
+#define OP_CPY()  COMPARE(y)
+#define OP_ASL() { \
+    uint8_t src = IS_ACC ? a : MEM; \
+    set_flag(cpu, FLAG_C, src & 0x80); \
+    src = src << 1; \
+    SET_NZ(src); \
+    if (IS_ACC) a = src; else { write8(cpu, addr, src); FIXED_TIMING(); } }
+#define OP_LSR() { \
+    uint8_t m = IS_ACC ? a : MEM; \
+    set_flag(cpu, FLAG_C, m & 1); \
+    m = m >> 1; \
+    if (IS_ACC) a = m; else { write8(cpu, addr, m); FIXED_TIMING(); } \
+    SET_NZ(m); }
+#define OP_ROL() { \
+    uint16_t m = IS_ACC ? a : MEM; \
+    m = (m << 1) | (get_flag(cpu, FLAG_C) ? 1 : 0); \
+    set_flag(cpu, FLAG_C, m > 0xff); \
+    m &= 0xFF; \
+    SET_NZ(m); \
+    if (IS_ACC) a = (uint8_t)m; else { write8(cpu, addr, m); FIXED_TIMING(); } }
+#define OP_ROR() { \
+    uint16_t m = IS_ACC ? a : MEM; \
+    m |= get_flag(cpu, FLAG_C) ? 0x100 : 0; \
+    set_flag(cpu, FLAG_C, m & 1); \
+    m = (m >> 1); \
+    SET_NZ(m); \
+    if (IS_ACC) a = (uint8_t)m; else { write8(cpu, addr, m); FIXED_TIMING(); } }
+#define OP_DEC()  { uint8_t m = MEM - 1; SET_NZ(m); write8(cpu, addr, m); FIXED_TIMING(); }
+#define OP_INC()  { uint8_t m = MEM + 1; SET_NZ(m); write8(cpu, addr, m); FIXED_TIMING(); }
+#define OP_DEX()  { x--; SET_NZ(x); }
+#define OP_DEY()  { y--; SET_NZ(y); }
+#define OP_INX()  { x++; SET_NZ(x); }
+#define OP_INY()  { y++; SET_NZ(y); }
+#define OP_LDA()  { a = MEM; SET_NZ(a); }
+#define OP_LDX()  { x = MEM; SET_NZ(x); }
+#define OP_LDY()  { y = MEM; SET_NZ(y); }
+#define OP_LAX()  { a = MEM; x = a; SET_NZ(a); }
+#define OP_STA()  { write8(cpu, addr, a); FIXED_TIMING(); }
+#define OP_STX()  write8(cpu, addr, x)
+#define OP_STY()  write8(cpu, addr, y)
+#define OP_SAX()  write8(cpu, addr, a & x)
+#define OP_DCP() { \
+    uint8_t m = MEM; \
+    write8(cpu, addr, m - 1); \
+    m = (uint16_t)a - m; \
+    SET_NZ(m); \
+    FIXED_TIMING(); }
+#define OP_TAX()  { x = a; SET_NZ(x); }
+#define OP_TAY()  { y = a; SET_NZ(y); }
+#define OP_TSX()  { x = sp; SET_NZ(x); }
+#define OP_TXA()  { a = x; SET_NZ(a); }
+#define OP_TYA()  { a = y; SET_NZ(a); }
+#define OP_TXS()  sp = x
+#define OP_PHA()  PUSH(a)
+#define OP_PHP()  PUSH(get_status(cpu) | FLAG_B)
+#define OP_PLA()  { a = PULL(); SET_NZ(a); }
+#define OP_PLP()  set_status(cpu, (PULL() & ~FLAG_B) | FLAG_R)
+#define OP_BCC()  BRANCH(!get_flag(cpu, FLAG_C))
+#define OP_BCS()  BRANCH(get_flag(cpu, FLAG_C))
+#define OP_BEQ()  BRANCH(get_flag(cpu, FLAG_Z))
+#define OP_BNE()  BRANCH(!get_flag(cpu, FLAG_Z))
+#define OP_BMI()  BRANCH(get_flag(cpu, FLAG_N))
+#define OP_BPL()  BRANCH(!get_flag(cpu, FLAG_N))
+#define OP_BVC()  BRANCH(!get_flag(cpu, FLAG_V))
+#define OP_BVS()  BRANCH(get_flag(cpu, FLAG_V))
+#define OP_CLC()  set_flag(cpu, FLAG_C, 0)
+#define OP_CLD()  set_flag(cpu, FLAG_D, 0)
+#define OP_CLI()  set_flag(cpu, FLAG_I, 0)
+#define OP_CLV()  set_flag(cpu, FLAG_V, 0)
+#define OP_SEC()  set_flag(cpu, FLAG_C, 1)
+#define OP_SED()  set_flag(cpu, FLAG_D, 1)
+#define OP_SEI()  set_flag(cpu, FLAG_I, 1)
+#define OP_JMP()  pc = addr - len
+#define OP_JSR() { \
+    uint16_t ret = pc + 2; \
+    PUSH(ret >> 8); \
+    PUSH(ret & 0xff); \
+    pc = addr - len; }
+#define OP_RTS() { \
+    uint16_t ret = PULL(); \
+    ret |= (uint16_t)PULL() << 8; \
+    pc = ret + 1 - len; }
+#define OP_RTI() { \
+    set_status(cpu, PULL() | FLAG_R); \
+    uint16_t ret = PULL(); \
+    ret |= (uint16_t)PULL() << 8; \
+    pc = ret - len; }
+#define OP_BRK() { \
+    bool intr = cpu->nmi || cpu->interrupt; \
+    uint16_t ret = pc + (intr ? 0 : 2); \
+    PUSH(ret >> 8); \
+    PUSH(ret & 0xff); \
+    PUSH(get_status(cpu) | (intr ? 0 : FLAG_B)); \
+    set_flag(cpu, FLAG_I, 1); \
+    pc = read16(cpu, cpu->nmi ? NMI_ADDR : INT_ADDR) - len; }
+#define OP_NOP()
+#define OP_ILL()
+#define OP_END()  cpu->halt = D6502_HALT_END
+
+// one case of the fused switch, adds the cycles to 'done' and the cpu
+#define FUSED_CASE(opc, op, am, l, cyc) \
+    case opc: { \
+        const uint8_t len = l; \
+        const uint8_t mode = MODE_##am; \
+        (void)len; \
+        (void)mode; \
+        AM_##am(); \
+        OP_##op(); \
+        pc += len; \
+        done += cyc + extra; \
+        cpu->cycles += cyc + extra; \
+        break; \
+    }
+
+#endif
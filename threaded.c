@@ -0,0 +1,234 @@
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+#include "operations.h"
+#include "switch_core_ops.h"
+#include "threaded.h"
+
+// Threaded code engine used by d6502_run() when cpu->engine is
+// D6502_ENGINE_THREADED and a block cache is attached. Straight runs of
+// code on immutable pages are decoded once into blocks of opcodes with
+// their operands, so running a block fetches nothing from the bus. The
+// ops run through the fused cases of switch_core.c with A, X, Y, SP and
+// PC in local variables, like in the switch engine bus callbacks must not
+// rely on these fields of the cpu.
+//
+// Code outside blocks and interrupts run one instruction at a time
+// through the same cases, decoded from the bus. Only an instruction that
+// follows a block, a branch, jump, call, return or interrupt is looked up
+// in the cache, a block is built when its start is reached BUILD_VISITS
+// times. Code which runs once or twice, like init code or most of
+// nestest, costs more to decode than to step through.
+//
+// A block is left early when an nmi/interrupt is raised, a write goes to
+// the write callback (which may switch banks or raise an irq) or the cycle
+// budget is used up.
+
+// the operand is decoded already, from a block or from the bus
+#define OPERAND8  ((uint8_t)operand)
+#define OPERAND16 operand
+
+#define BUILD_VISITS 4
+
+// instruction lengths, 0 for undefined opcodes
+static const uint8_t lengths[256] = {
+#define INSTRUCTION(opc, op, mnemonic, am, l, cyc) [opc] = l,
+#include "instruction_table.def"
+#undef INSTRUCTION
+};
+
+static int slot(uint16_t pc) {
+    return pc & (D6502_BLOCK_CACHE_SIZE - 1);
+}
+
+static bool is_immutable(d6502_t *cpu, uint16_t addr) {
+    return cpu->page_flags[addr >> 8] & D6502_PAGE_IMMUTABLE;
+}
+
+// instructions that change the pc other than by their length end a block
+static bool ends_block(const instruction_t *instruction) {
+    void (*op)(d6502_t *) = instruction->operation;
+    return instruction->mode == MODE_RELATIVE || op == JMP || op == JSR
+        || op == RTS || op == RTI || op == BRK || op == END;
+}
+
+// build:
+// decode the block starting at pc into its slot, count is 0 if there is
+// no cacheable code
+static void build(d6502_t *cpu, uint16_t pc) {
+    d6502_block_tag_t *t = &cpu->blocks->tag[slot(pc)];
+    d6502_block_t *b = &cpu->blocks->block[slot(pc)];
+    t->pc = pc;
+    t->count = 0;
+    while (t->count < D6502_BLOCK_MAX_LEN) {
+        uint8_t opcode = peek8(cpu, pc);
+        const instruction_t *instruction = get_instruction(opcode);
+        if (instruction->operation == NULL) {
+            break; // undefined opcode, leave it to the bus path
+        }
+        uint16_t last = pc + instruction->len - 1;
+        if (!is_immutable(cpu, last)) {
+            break;
+        }
+        d6502_threaded_op_t *op = &b->op[t->count++];
+        op->opcode = opcode;
+        op->operand = 0;
+        if (instruction->len > 1) {
+            op->operand = peek8(cpu, pc + 1);
+        }
+        if (instruction->len > 2) {
+            op->operand |= peek8(cpu, pc + 2) << 8;
+        }
+        cpu->page_flags[pc >> 8] |= D6502_PAGE_CACHED;
+        cpu->page_flags[last >> 8] |= D6502_PAGE_CACHED;
+        pc += instruction->len;
+        if (ends_block(instruction) || !is_immutable(cpu, pc)) {
+            break;
+        }
+    }
+    b->end = pc;
+}
+
+// operand of the instruction at pc, read from the bus like step() does
+static uint16_t fetch_operand(d6502_t *cpu, uint16_t pc, uint8_t opcode) {
+    uint16_t operand = 0;
+    if (lengths[opcode] > 1) {
+        operand = read8(cpu, pc + 1);
+    }
+    if (lengths[opcode] > 2) {
+        operand |= read8(cpu, pc + 2) << 8;
+    }
+    return operand;
+}
+
+int threaded_run(d6502_t *cpu, int cycles) {
+    uint8_t a = cpu->a;
+    uint8_t x = cpu->x;
+    uint8_t y = cpu->y;
+    uint8_t sp = cpu->sp;
+    uint16_t pc = cpu->pc;
+    uint16_t addr = cpu->addr;
+    uint8_t opcode = cpu->instruction->opcode;
+    uint8_t extra = 0;
+    int done = 0;
+
+    while (done < cycles && !cpu->halt) {
+        const bool serviced = cpu->nmi || cpu->interrupt;
+        int count = 0;
+        if (!serviced && is_immutable(cpu, pc)) {
+            d6502_block_tag_t *t = &cpu->blocks->tag[slot(pc)];
+            if (t->pc != pc) {
+                // first visit
+                t->pc = pc;
+                t->count = 0;
+                t->visits = 1;
+            } else if (t->count == 0 && ++t->visits >= BUILD_VISITS) {
+                build(cpu, pc);
+            }
+            count = t->count;
+        }
+        // ops of the block, the block may be dropped by a write while it runs
+        const d6502_threaded_op_t *op = cpu->blocks->block[slot(pc)].op;
+        const d6502_threaded_op_t *last = count ? op + count - 1 : op;
+        uint16_t operand;
+        uint16_t entry = pc; // start of the block
+        if (count) {
+            opcode = op->opcode;
+            operand = op->operand;
+        } else if (serviced) {
+            opcode = 0x00; // BRK opcode
+            operand = 0;
+        } else {
+            opcode = read8(cpu, pc);
+            operand = fetch_operand(cpu, pc, opcode);
+        }
+        cpu->bus_write = false;
+        for (;;) {
+            const uint16_t start = pc;
+            extra = 0;
+            switch (opcode) {
+#define INSTRUCTION(opc, op, mnemonic, am, l, cyc) FUSED_CASE(opc, op, am, l, cyc)
+#include "instruction_table.def"
+#undef INSTRUCTION
+                default: // illegal instruction -> perform NOP
+                    opcode = 0xEA;
+                    pc += 1;
+                    done += 2;
+                    cpu->cycles += 2;
+            }
+            cpu->instructions++;
+            if (done >= cycles || cpu->nmi || cpu->interrupt || cpu->bus_write || cpu->halt) {
+                break;
+            }
+            if (op != last) {
+                op++;
+            } else if (count == 0) {
+                // go on with the next instruction from the bus unless it
+                // may start a block: it follows a branch, jump, call,
+                // return or interrupt. The branches are the opcodes xxx10000.
+                if (serviced || (uint16_t)(pc - start - 1) > 2 || (opcode & 0x1f) == 0x10) {
+                    break;
+                }
+                opcode = read8(cpu, pc);
+                operand = fetch_operand(cpu, pc, opcode);
+                continue;
+            } else if (pc == entry) {
+                // a loop
+                op = last - (count - 1);
+            } else {
+                // go on with the next block if it is built already
+                const d6502_block_tag_t *t = &cpu->blocks->tag[slot(pc)];
+                if (t->pc != pc || t->count == 0) {
+                    break;
+                }
+                op = cpu->blocks->block[slot(pc)].op;
+                count = t->count;
+                last = op + count - 1;
+                entry = pc;
+            }
+            opcode = op->opcode;
+            operand = op->operand;
+        }
+        if (!serviced) {
+            // raised by a bus callback during this instruction, keep it pending
+        } else if (cpu->nmi) {
+            cpu->nmi = false;
+        } else if (cpu->interrupt) {
+            cpu->interrupt = false;
+        }
+    }
+
+    cpu->a = a;
+    cpu->x = x;
+    cpu->y = y;
+    cpu->sp = sp;
+    cpu->pc = pc;
+    cpu->addr = addr;
+    cpu->instruction = get_instruction(opcode);
+    cpu->extra_clocks = extra;
+    return done;
+}
+
+void threaded_invalidate(d6502_t *cpu, uint16_t addr, int len) {
+    if (cpu->blocks == NULL) {
+        return;
+    }
+    for (int i = 0; i < D6502_BLOCK_CACHE_SIZE; i++) {
+        d6502_block_tag_t *t = &cpu->blocks->tag[i];
+        // blocks do not wrap around $FFFF, end may be 0 though
+        int start = t->pc;
+        int end = cpu->blocks->block[i].end > t->pc ? cpu->blocks->block[i].end : 0x10000;
+        if (t->count && start < addr + len && addr < end) {
+            t->count = 0;
+        }
+    }
+}
+
+void threaded_prepare(d6502_t *cpu, uint16_t pc) {
+    if (is_immutable(cpu, pc)) {
+        d6502_block_tag_t *t = &cpu->blocks->tag[slot(pc)];
+        if (t->count == 0 || t->pc != pc) {
+            build(cpu, pc);
+        }
+    }
+}
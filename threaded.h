@@ -0,0 +1,16 @@
+#ifndef __THREADED_H
+#define __THREADED_H
+
+#include "d6502.h"
+
+// executes whole instructions until at least 'cycles' have passed,
+// returns the number of cycles executed
+int threaded_run(d6502_t *cpu, int cycles);
+
+// drops all blocks containing code in addr..addr+len-1
+void threaded_invalidate(d6502_t *cpu, uint16_t addr, int len);
+
+// builds the block starting at pc, unless it is cached already
+void threaded_prepare(d6502_t *cpu, uint16_t pc);
+
+#endif
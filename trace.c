@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <string.h>
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+
+// Trace file format, all values little endian:
+//
+//   header:  "D6TR", u32 version (1), u32 number of records, u32 record size (16)
+//   record:  u32 cycles, u16 pc, u16 operand, u8 opcode, a, x, y, p, sp, flags,
+//            1 byte padding
+//
+// Records are stored oldest first.
+
+#define TRACE_VERSION 1
+#define TRACE_RECORD_SIZE 16
+
+void trace_record(d6502_t *cpu, bool serviced) {
+    d6502_trace_t *t = cpu->trace;
+    d6502_trace_record_t *r = &t->records[t->count++ & (t->size - 1)];
+    r->cycles = cpu->cycles;
+    r->pc = cpu->pc;
+    // a serviced nmi/interrupt has no operand, cpu->operand is left over
+    r->operand = serviced ? 0 : cpu->operand;
+    // undefined opcodes have an empty table entry without their number, its
+    // index is the fetched opcode (no bus access, unlike peek8())
+    r->opcode = cpu->instruction - get_instruction(0);
+    r->a = cpu->a;
+    r->x = cpu->x;
+    r->y = cpu->y;
+    r->p = get_status(cpu);
+    r->sp = cpu->sp;
+    // the nmi wins, like in step()
+    r->flags = !serviced ? 0 : cpu->nmi ? D6502_TRACE_NMI : D6502_TRACE_IRQ;
+}
+
+void d6502_trace_attach(d6502_t *cpu, d6502_trace_t *trace, d6502_trace_record_t *records, uint32_t size) {
+    if (trace) {
+        trace->records = records;
+        trace->size = size;
+        trace->count = 0;
+    }
+    cpu->trace = trace;
+}
+
+bool d6502_trace_save(const d6502_trace_t *trace, const char *fn) {
+    FILE *f = fopen(fn, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    uint64_t n = trace->count < trace->size ? trace->count : trace->size;
+    uint8_t buf[TRACE_RECORD_SIZE];
+    memcpy(buf, "D6TR", 4);
+    put32(buf + 4, TRACE_VERSION);
+    put32(buf + 8, n);
+    put32(buf + 12, TRACE_RECORD_SIZE);
+    bool ok = fwrite(buf, sizeof(buf), 1, f) == 1;
+    for (uint64_t i = trace->count - n; ok && i < trace->count; i++) {
+        const d6502_trace_record_t *r = &trace->records[i & (trace->size - 1)];
+        memset(buf, 0, sizeof(buf));
+        put32(buf, r->cycles);
+        put16(buf + 4, r->pc);
+        put16(buf + 6, r->operand);
+        buf[8] = r->opcode;
+        buf[9] = r->a;
+        buf[10] = r->x;
+        buf[11] = r->y;
+        buf[12] = r->p;
+        buf[13] = r->sp;
+        buf[14] = r->flags;
+        ok = fwrite(buf, sizeof(buf), 1, f) == 1;
+    }
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,67 @@
+#include "d6502.h"
+#include "d6502_private.h"
+#include "instruction_table.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+// Renders a trace file written by d6502_trace_save() in the format of
+// test/nestest.log (without the PPU column).
+//
+// usage: tracedump trace.bin
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.bin\n", argv[0]);
+        return 2;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", argv[1]);
+        return 2;
+    }
+    uint8_t hdr[16];
+    if (fread(hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr, "D6TR", 4) != 0
+        || get32(hdr + 4) != 1 || get32(hdr + 12) < 15) {
+        fprintf(stderr, "%s is not a trace file\n", argv[1]);
+        return 2;
+    }
+    uint32_t n = get32(hdr + 8);
+    uint32_t size = get32(hdr + 12);
+    uint8_t *r = malloc(size);
+    uint64_t cycles = 0;
+    for (uint32_t i = 0; i < n && fread(r, size, 1, f) == 1; i++) {
+        // widen the 32 bit cycle count, records are less than 2^32 cycles apart
+        uint32_t c = get32(r);
+        if (i == 0) {
+            cycles = c;
+        } else {
+            cycles += (uint32_t)(c - (uint32_t)cycles);
+        }
+        uint16_t pc = get16(r + 4);
+        uint16_t operand = get16(r + 6);
+        uint8_t opcode = r[8];
+        int len = get_instruction(opcode)->len;
+        char bytes[16];
+        char asmcode[32];
+        if (len == 3) {
+            sprintf(bytes, "%02X %02X %02X", opcode, operand & 0xff, operand >> 8);
+        } else if (len == 2) {
+            sprintf(bytes, "%02X %02X", opcode, operand & 0xff);
+        } else {
+            sprintf(bytes, "%02X", opcode);
+        }
+        uint8_t flags = r[14];
+        if (flags & (D6502_TRACE_NMI | D6502_TRACE_IRQ)) {
+            // serviced, not a BRK
+            strcpy(asmcode, flags & D6502_TRACE_NMI ? "*NMI" : "*IRQ");
+        } else {
+            d6502_disassemble_bytes(pc, opcode, operand, asmcode);
+        }
+        printf("%04X  %-8s  %-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%lu\n",
+            pc, bytes, asmcode, r[9], r[10], r[11], r[12], r[13], (unsigned long)cycles);
+    }
+    free(r);
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <string.h>
+#include "d6502.h"
+#include "d6502_private.h"
+
+// Breakpoints and watchpoints.
+//
+// Armed addresses are kept in one bitmap per kind. A page with read or
+// write watches is marked D6502_PAGE_WATCH and its direct pointers are
+// moved from the page table into the watch, so all its accesses take the
+// slow path of read8()/write8(), which ends up here. Accesses to all other
+// pages stay direct and cost nothing extra. A page with breakpoints is
+// marked D6502_PAGE_BREAK, breakpoint() only looks at the bitmap on those
+// pages. While breakpoints are armed, d6502_run() uses the table engine.
+
+static bool test(const uint8_t *bits, uint16_t addr) {
+    return (bits[addr >> 3] >> (addr & 7)) & 1;
+}
+
+static void hit(d6502_t *cpu, uint16_t addr, uint8_t kind, uint8_t value) {
+    d6502_watch_t *w = cpu->watch;
+    if (cpu->halt == D6502_RUNNING) {
+        // the first hit of an instruction is reported
+        cpu->halt = kind == D6502_WATCH_EXEC ? D6502_HALT_BREAK : D6502_HALT_WATCH;
+        w->hit_addr = addr;
+        w->hit_kind = kind;
+        w->hit_value = value;
+    }
+}
+
+// moves the direct pointers of a page with read/write watches out of the
+// page table, or back
+static void divert(d6502_t *cpu, uint8_t page) {
+    d6502_watch_t *w = cpu->watch;
+    bool watched = w->read_count[page] || w->write_count[page];
+    if (watched && !(cpu->page_flags[page] & D6502_PAGE_WATCH)) {
+        w->read_page[page] = cpu->read_page[page];
+        w->write_page[page] = cpu->write_page[page];
+        cpu->read_page[page] = NULL;
+        cpu->write_page[page] = NULL;
+        cpu->page_flags[page] |= D6502_PAGE_WATCH;
+    } else if (!watched && (cpu->page_flags[page] & D6502_PAGE_WATCH)) {
+        cpu->read_page[page] = w->read_page[page];
+        cpu->write_page[page] = w->write_page[page];
+        cpu->page_flags[page] &= ~D6502_PAGE_WATCH;
+    }
+}
+
+void watch_map(d6502_t *cpu, uint8_t page) {
+    if (cpu->page_flags[page] & D6502_PAGE_WATCH) {
+        cpu->page_flags[page] &= ~D6502_PAGE_WATCH;
+        divert(cpu, page);
+    }
+}
+
+uint8_t watch_read(d6502_t *cpu, uint16_t addr) {
+    d6502_watch_t *w = cpu->watch;
+    const uint8_t *page = w->read_page[addr >> 8];
+    uint8_t dat = page ? page[addr & 0xff] : cpu->read(cpu->userdata, addr);
+    if (test(w->read, addr)) {
+        hit(cpu, addr, D6502_WATCH_READ, dat);
+    }
+    return dat;
+}
+
+void watch_write(d6502_t *cpu, uint16_t addr, uint8_t dat) {
+    d6502_watch_t *w = cpu->watch;
+    if (test(w->write, addr)) {
+        hit(cpu, addr, D6502_WATCH_WRITE, dat);
+    }
+    uint8_t *page = w->write_page[addr >> 8];
+    if (page) {
+        page[addr & 0xff] = dat;
+        return;
+    }
+    if (cpu->page_flags[addr >> 8] & D6502_PAGE_CACHED) {
+        invalidate_page(cpu, addr >> 8);
+    }
+    cpu->bus_write = true;
+    cpu->write(cpu->userdata, addr, dat);
+}
+
+bool watch_break(d6502_t *cpu) {
+    d6502_watch_t *w = cpu->watch;
+    if (w->skip == cpu->pc) {
+        // resuming from this breakpoint
+        w->skip = -1;
+        return false;
+    }
+    w->skip = -1;
+    if (!test(w->exec, cpu->pc)) {
+        return false;
+    }
+    hit(cpu, cpu->pc, D6502_WATCH_EXEC, 0);
+    w->skip = cpu->pc;
+    return true;
+}
+
+uint8_t peek8(d6502_t *cpu, uint16_t addr) {
+    const uint8_t *page = cpu->read_page[addr >> 8];
+    if (page == NULL && (cpu->page_flags[addr >> 8] & D6502_PAGE_WATCH)) {
+        page = cpu->watch->read_page[addr >> 8];
+    }
+    return page ? page[addr & 0xff] : cpu->read(cpu->userdata, addr);
+}
+
+void d6502_watch_attach(d6502_t *cpu, d6502_watch_t *watch) {
+    if (cpu->watch) {
+        // give the diverted pages back
+        memset(cpu->watch->read_count, 0, sizeof(cpu->watch->read_count));
+        memset(cpu->watch->write_count, 0, sizeof(cpu->watch->write_count));
+        for (int page = 0; page < 256; page++) {
+            divert(cpu, page);
+            cpu->page_flags[page] &= ~D6502_PAGE_BREAK;
+        }
+    }
+    if (watch) {
+        memset(watch, 0, sizeof(*watch));
+        watch->skip = -1;
+    }
+    cpu->watch = watch;
+}
+
+void d6502_watch(d6502_t *cpu, uint16_t addr, int len, uint8_t kinds, bool armed) {
+    d6502_watch_t *w = cpu->watch;
+    uint8_t *bits[3] = { w->read, w->write, w->exec };
+    uint16_t *counts[3] = { w->read_count, w->write_count, w->exec_count };
+    for (int i = 0; i < len; i++) {
+        uint16_t a = addr + i;
+        uint8_t page = a >> 8;
+        for (int k = 0; k < 3; k++) {
+            if (!(kinds & (1 << k)) || test(bits[k], a) == armed) {
+                continue;
+            }
+            bits[k][a >> 3] ^= 1 << (a & 7);
+            counts[k][page] += armed ? 1 : -1;
+            if (k == 2) {
+                w->breakpoints += armed ? 1 : -1;
+            }
+        }
+        divert(cpu, page);
+        if (w->exec_count[page]) {
+            cpu->page_flags[page] |= D6502_PAGE_BREAK;
+        } else {
+            cpu->page_flags[page] &= ~D6502_PAGE_BREAK;
+        }
+    }
+}